@@ -0,0 +1,115 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace e3d {
+
+    // Linear (bump) allocator for transient per-frame data
+    //
+    // Allocations are served from one block by bumping an offset and are all
+    // released together by reset(), which just moves the offset back. If a
+    // frame needs more than the block holds, the excess comes from overflow
+    // blocks, and the next reset() grows the main block to cover it, so a
+    // steady-state frame never touches the heap.
+    class FrameArena {
+        public:
+            explicit FrameArena(const size_t bytes = 256 * 1024)
+                : block {new unsigned char[bytes]}, blockSize {bytes} {}
+
+            FrameArena(const FrameArena&) = delete;
+            FrameArena& operator=(const FrameArena&) = delete;
+
+            void* allocate(const size_t bytes, const size_t alignment = alignof(std::max_align_t)) {
+                void* p = bump(block.get(), blockSize, offset, bytes, alignment);
+                if (!p) {
+                    p = allocateOverflow(bytes, alignment);
+                }
+                allocated += bytes;
+                return p;
+            }
+
+            // Room for 'n' default-constructed objects of type T. Nothing is
+            // ever destroyed, so T must be trivially destructible.
+            template <typename T>
+            T* allocate(const size_t n) {
+                static_assert(std::is_trivially_destructible<T>::value,
+                              "FrameArena never runs destructors");
+                T* p = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+                for (size_t i = 0; i < n; ++i) {
+                    new (p + i) T();
+                }
+                return p;
+            }
+
+            // Releases everything allocated since the last reset
+            void reset() {
+                if (!overflow.empty()) {
+                    size_t needed = blockSize + overflowBytes;
+                    overflow.clear();
+                    overflowBytes = 0;
+                    block.reset(new unsigned char[needed]);
+                    blockSize = needed;
+                }
+                offset = 0;
+                allocated = 0;
+            }
+
+            // Bytes handed out since the last reset
+            size_t used() const {
+                return allocated;
+            }
+
+            size_t capacity() const {
+                return blockSize;
+            }
+
+        private:
+            std::unique_ptr<unsigned char[]> block;
+            size_t blockSize;
+            size_t offset = 0;
+            size_t allocated = 0;
+
+            struct Overflow {
+                std::unique_ptr<unsigned char[]> data;
+                size_t size;
+                size_t offset;
+            };
+            std::vector<Overflow> overflow;
+            size_t overflowBytes = 0;
+
+            static void* bump(unsigned char* base, const size_t size, size_t& used,
+                              const size_t bytes, const size_t alignment) {
+                std::uintptr_t start = reinterpret_cast<std::uintptr_t>(base) + used;
+                std::uintptr_t aligned = (start + alignment - 1) & ~std::uintptr_t(alignment - 1);
+                size_t end = aligned - reinterpret_cast<std::uintptr_t>(base) + bytes;
+                if (end > size) {
+                    return nullptr;
+                }
+                used = end;
+                return reinterpret_cast<void*>(aligned);
+            }
+
+            void* allocateOverflow(const size_t bytes, const size_t alignment) {
+                if (!overflow.empty()) {
+                    Overflow& last = overflow.back();
+                    if (void* p = bump(last.data.get(), last.size, last.offset, bytes, alignment)) {
+                        return p;
+                    }
+                }
+                size_t size = std::max(blockSize, bytes + alignment);
+                overflow.push_back(Overflow{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size, 0});
+                overflowBytes += size;
+                return bump(overflow.back().data.get(), size, overflow.back().offset, bytes, alignment);
+            }
+    };
+
+}
+
+#endif // ARENA_H_
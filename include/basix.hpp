@@ -16,6 +16,8 @@
  * - pow2(base): returns 'base' squared
  * - random_int(min, max): returns a random int between 'min' and 'max'
  * - random_double(min, max): returns a random double between 'min' and 'max'
+ * - random_fill(v, min, max): fills vector 'v' with random numbers between 'min' and 'max'
+ * - seed_random(seed): makes the random numbers of this thread repeatable
  * - sort(c): sorts the elements of 'c' (a container) using the '<' operator
  * - sort(c, p): sorts the elements of 'c' (a container) using the predicate 'p'
  * - find(c, v): searches for value 'v' in container 'c'; returns an iterator
@@ -27,12 +29,15 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <assert.h>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <forward_list>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <list>
@@ -46,11 +51,24 @@
 #include <unordered_map>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BASIX_SSE2
+#endif
+
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
 #include <SFML/System.hpp>
 #include <SFML/Audio.hpp>
 
+#include "jobs.hpp"
+
+// Rectangle packing for Texture_atlas, compiled into every file that needs it
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+#undef STB_RECT_PACK_IMPLEMENTATION
+
 using namespace std;
 
 namespace basix
@@ -143,6 +161,109 @@ inline double pow2(double base)
   return base * base;
 }
 
+// Random numbers
+//
+// Each thread draws from its own xoshiro256** engine (Blackman and Vigna), so
+// the functions below need no locks and keep 32 bytes of state per thread.
+// Engines are seeded from std::random_device once, when a thread first asks
+// for a number. seed_random() makes runs repeatable, as replays need it: the
+// calling thread restarts from the seed, and threads that draw their first
+// number afterwards get seeds derived from it in that order.
+class Random_engine
+{
+ public:
+  using result_type = std::uint64_t;
+
+  explicit Random_engine(const std::uint64_t seed = 0);
+  void seed(std::uint64_t seed);
+  result_type operator()();
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+ private:
+  std::uint64_t _state[4];
+};
+
+inline Random_engine::Random_engine(const std::uint64_t seed)
+{
+  this->seed(seed);
+}
+
+// Spreads the seed over the whole state with splitmix64, so that nearby
+// seeds give unrelated sequences and the state is never all zero
+inline void Random_engine::seed(std::uint64_t seed)
+{
+  for (std::uint64_t &word : _state)
+  {
+    std::uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    word = z ^ (z >> 31);
+  }
+}
+
+inline Random_engine::result_type Random_engine::operator()()
+{
+  auto rotl = [](const std::uint64_t x, const int k) { return (x << k) | (x >> (64 - k)); };
+  const std::uint64_t result = rotl(_state[1] * 5, 7) * 9;
+  const std::uint64_t t = _state[1] << 17;
+  _state[2] ^= _state[0];
+  _state[3] ^= _state[1];
+  _state[1] ^= _state[2];
+  _state[0] ^= _state[3];
+  _state[2] ^= t;
+  _state[3] = rotl(_state[3], 45);
+  return result;
+}
+
+// Where new threads take their seeds from; 0 until seed_random() is called
+inline std::atomic<std::uint64_t> &random_seed_source()
+{
+  static std::atomic<std::uint64_t> source{0};
+  return source;
+}
+
+// The calling thread's engine
+inline Random_engine &random_engine()
+{
+  thread_local Random_engine engine{[] {
+    std::uint64_t base = random_seed_source().fetch_add(1);
+    if (base != 0)
+      return base;
+    std::random_device rd;
+    return (std::uint64_t(rd()) << 32) ^ rd();
+  }()};
+  return engine;
+}
+
+// Restarts the calling thread's numbers from 'seed'
+inline void seed_random(const std::uint64_t seed)
+{
+  random_seed_source() = seed * 0x9e3779b97f4a7c15ull | 1;
+  random_engine().seed(seed);
+}
+
+// An int in 0..n-1 (n > 0) with no bias, by Lemire's multiply and shift
+inline std::uint32_t random_below(Random_engine &engine, const std::uint32_t n)
+{
+  std::uint64_t m = (engine() >> 32) * n;
+  if (std::uint32_t(m) < n)
+  {
+    const std::uint32_t threshold = (0u - n) % n;
+    while (std::uint32_t(m) < threshold)
+      m = (engine() >> 32) * n;
+  }
+  return std::uint32_t(m >> 32);
+}
+
+inline int random_int(Random_engine &engine, const int min, const int max)
+{
+  const std::uint32_t span = std::uint32_t(max) - std::uint32_t(min);
+  if (span == UINT32_MAX)
+    return int(std::uint32_t(engine() >> 32));
+  return int(std::uint32_t(min) + random_below(engine, span + 1));
+}
+
 const int DEFAULT_MIN_RANDOM_INT = 0;
 const int DEFAULT_MAX_RANDOM_INT = 10;
 
@@ -153,10 +274,7 @@ inline int random_int(int min = DEFAULT_MIN_RANDOM_INT, int max = DEFAULT_MAX_RA
 {
   if (min <= max)
   {
-    std::uniform_int_distribution<int> distribution(min, max);
-    std::random_device rd;
-    std::mt19937 random_generator(rd());
-    return distribution(random_generator);
+    return random_int(random_engine(), min, max);
   }
   else
   {
@@ -168,16 +286,14 @@ const double DEFAULT_MIN_RANDOM_DOUBLE = 0.0;
 const double DEFAULT_MAX_RANDOM_DOUBLE = 1.0;
 
 // Returns a random double between 'min' and 'max'
-// If 'min' and 'max' are not specified, the range is 0..10
+// If 'min' and 'max' are not specified, the range is 0..1
 
 inline double random_double(double min = DEFAULT_MIN_RANDOM_DOUBLE, double max = DEFAULT_MAX_RANDOM_DOUBLE)
 {
   if (min <= max)
   {
-    std::uniform_real_distribution<double> distribution(min, max);
-    std::random_device rd;
-    std::mt19937 random_generator(rd());
-    return distribution(random_generator);
+    // The top 53 bits give a double in [0, 1)
+    return min + (max - min) * (double(random_engine()() >> 11) * 0x1.0p-53);
   }
   else
   {
@@ -185,6 +301,44 @@ inline double random_double(double min = DEFAULT_MIN_RANDOM_DOUBLE, double max =
   }
 }
 
+// Fills 'values' with random numbers between 'min' and 'max', as
+// random_int() and random_double() would, but with the engine held in a
+// local for the whole loop
+inline void random_fill(std::vector<int> &values, int min, int max)
+{
+  if (min > max)
+    throw "random_fill: lower bound is greater than upper bound";
+  Random_engine &shared = random_engine();
+  Random_engine engine = shared;
+  for (int &value : values)
+    value = random_int(engine, min, max);
+  shared = engine;
+}
+
+inline void random_fill(std::vector<double> &values, double min, double max)
+{
+  if (min > max)
+    throw "random_fill: lower bound is greater than upper bound";
+  Random_engine &shared = random_engine();
+  Random_engine engine = shared;
+  const double scale = (max - min) * 0x1.0p-53;
+  for (double &value : values)
+    value = min + double(engine() >> 11) * scale;
+  shared = engine;
+}
+
+inline void random_fill(std::vector<float> &values, float min, float max)
+{
+  if (min > max)
+    throw "random_fill: lower bound is greater than upper bound";
+  Random_engine &shared = random_engine();
+  Random_engine engine = shared;
+  const float scale = (max - min) * 0x1.0p-24f;
+  for (float &value : values)
+    value = min + float(engine() >> 40) * scale;
+  shared = engine;
+}
+
 template <typename C>
 using Value_type = typename C::value_type;
 
@@ -243,50 +397,1083 @@ using sf::Vector2i;
 
 // Resource holders
 
+// How Resource_holder loads a Resource in two steps. decode() reads the file
+// into a Staged object on a loader thread and must not touch the GPU;
+// upload() turns it into the Resource on the main thread, or returns null.
+// By default the whole of loadFromFile runs on the loader thread.
+// decode_memory() is decode() from a file already read into 'bytes', which
+// outlive the Resource. size_of() is the memory a loaded Resource takes, for
+// the holder's budget.
+template <typename Resource>
+struct Resource_loader
+{
+  using Staged = Resource;
+  static bool decode(Staged &staged, const std::string &filename);
+  static bool decode_memory(Staged &staged, const std::vector<char> &bytes);
+  static std::unique_ptr<Resource> upload(std::unique_ptr<Staged> staged);
+  static std::size_t size_of(const Resource &resource);
+};
+
+template <typename Resource>
+inline bool Resource_loader<Resource>::decode(Staged &staged, const std::string &filename)
+{
+  return staged.loadFromFile(filename);
+}
+
+template <typename Resource>
+inline bool Resource_loader<Resource>::decode_memory(Staged &staged, const std::vector<char> &bytes)
+{
+  return staged.loadFromMemory(bytes.data(), bytes.size());
+}
+
+template <typename Resource>
+inline std::unique_ptr<Resource> Resource_loader<Resource>::upload(std::unique_ptr<Staged> staged)
+{
+  return staged;
+}
+
+template <typename Resource>
+inline std::size_t Resource_loader<Resource>::size_of(const Resource &resource)
+{
+  return sizeof(resource);
+}
+
+template <>
+inline std::size_t Resource_loader<sf::SoundBuffer>::size_of(const sf::SoundBuffer &buffer)
+{
+  return sizeof(buffer) + buffer.getSampleCount() * sizeof(sf::Int16);
+}
+
+// Threads that decode resources for load_async(), started on first use.
+// The counter is declared first so that it outlives the threads.
+struct Loader_pool
+{
+  jobs::Counter loading;
+  jobs::JobSystem threads{2};
+};
+
+inline Loader_pool &loader_pool()
+{
+  static Loader_pool pool;
+  return pool;
+}
+
+// Reads the whole of a file into 'bytes'; false if it can't be read
+inline bool read_file(const std::string &filename, std::vector<char> &bytes)
+{
+  std::ifstream in(filename, std::ios::binary | std::ios::ate);
+  if (!in)
+    return false;
+  bytes.resize(std::size_t(in.tellg()));
+  in.seekg(0);
+  return bool(in.read(bytes.data(), std::streamsize(bytes.size())));
+}
+
+// 64-bit FNV-1a hash
+inline std::uint64_t fnv1a_hash(const std::vector<char> &bytes)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  for (const char byte : bytes)
+    hash = (hash ^ static_cast<unsigned char>(byte)) * 1099511628211ull;
+  return hash;
+}
+
+// Small integer that names a resource in a Resource_holder
+//
+// get(handle) is an array index, where get(id) hashes the id. The generation
+// tells a handle to an evicted resource from one to whatever reused its slot;
+// a default-constructed handle names nothing.
+template <typename Resource>
+struct Resource_handle
+{
+  std::uint32_t index = 0;
+  std::uint32_t generation = 0;
+  bool valid() const { return generation != 0; }
+};
+
+template <typename Resource>
+inline bool operator==(const Resource_handle<Resource> a, const Resource_handle<Resource> b)
+{
+  return a.index == b.index && a.generation == b.generation;
+}
+
+template <typename Resource>
+inline bool operator!=(const Resource_handle<Resource> a, const Resource_handle<Resource> b)
+{
+  return !(a == b);
+}
+
+// Loads resources, caches them and hands them out by id or handle
+//
+// load() reads a file on the calling thread. load_async() decodes it on the
+// loader pool instead; the main thread then finishes a few pending loads per
+// frame with finish_loads(budget), which also uploads textures to the GPU.
+// The returned future is ready once that has happened, so the main thread
+// should poll it (or is_loaded()) rather than wait on it:
+//
+//     auto level = texture_holder.load_async("level2.png", "level2.png");
+//     ...
+//     // every frame
+//     texture_holder.finish_loads(milliseconds(2));
+//
+// load() and get() on an id that is still loading finish it right away.
+// get() throws for ids that aren't loaded and for handles to evicted
+// resources.
+//
+// Ids are only looked up when loading or calling handle(); code that fetches
+// a resource often, like every frame, should keep the Handle that load()
+// returns and get() by that.
+//
+// Loading an id that is already loaded reads nothing. Each load of an id
+// takes a reference to its resource and release() gives one back. Resources
+// nobody references stay cached until the memory budget, if one is set, is
+// exceeded; then the least recently used of them are evicted. With
+// deduplication on, files are read whole, hashed and decoded from memory,
+// and ids whose files have the same bytes share a single resource. To tell
+// those from hash collisions, each resource keeps the bytes of its file,
+// which count against the budget.
 template <typename Resource, typename Identifier>
 class Resource_holder
 {
  public:
-  void load(Identifier id, const std::string &filename);
+  using Handle = Resource_handle<Resource>;
+
+  Handle load(Identifier id, const std::string &filename);
+  Handle add(Identifier id, std::unique_ptr<Resource> resource);
+  std::shared_future<Resource *> load_async(Identifier id, const std::string &filename);
+  std::size_t finish_loads(const Time budget);
+  void release(Identifier id);
+  Handle handle(Identifier id) const;
+  bool is_loaded(Identifier id) const;
+  bool is_loaded(const Handle handle) const;
+  std::size_t pending_loads() const;
+  int references(Identifier id) const;
   Resource &get(Identifier id);
   const Resource &get(Identifier id) const;
+  Resource &get(const Handle handle);
+  const Resource &get(const Handle handle) const;
+
+  void set_deduplication(const bool enabled);
+  void set_memory_budget(const std::size_t bytes);
+  std::size_t memory_used() const;
 
  private:
-  std::map<Identifier, std::unique_ptr<Resource>> _resource_map;
+  using Loader = Resource_loader<Resource>;
+
+  struct Entry
+  {
+    std::unique_ptr<Resource> resource; // null once evicted
+    std::uint64_t content_hash;         // 0 when not hashed
+    std::vector<char> content;          // the file's bytes when hashed
+    std::size_t bytes;
+    int references;
+    std::uint64_t last_used;
+    std::uint32_t generation; // bumped when the slot is reused
+  };
+
+  struct Pending
+  {
+    Identifier id;
+    std::string filename;
+    int references = 1;
+    bool deduplicate = false;
+    std::uint64_t content_hash = 0;             // set by the loader thread
+    std::vector<char> content;                  // set by the loader thread
+    std::unique_ptr<typename Loader::Staged> staged;
+    std::promise<bool> decoding;                // set by the loader thread
+    std::future<bool> decoded;
+    std::promise<Resource *> loaded;
+    std::shared_future<Resource *> result;
+  };
+
+  using Pending_list = std::list<std::shared_ptr<Pending>>;
+
+  Entry *find_entry(const Identifier &id);
+  const Entry *find_entry(const Identifier &id) const;
+  typename Pending_list::iterator find_pending(const Identifier &id);
+  void complete(typename Pending_list::iterator pending);
+  void finish(Pending &pending);
+  Resource *share_duplicate(const Identifier &id, const std::uint64_t content_hash,
+                            const std::vector<char> &content, const int references);
+  Resource *insert(const Identifier &id, std::unique_ptr<Resource> resource,
+                   const std::uint64_t content_hash, std::vector<char> content, const int references);
+  void evict();
+
+  std::vector<Entry> _entries;
+  std::vector<std::size_t> _free_entries;
+  std::unordered_map<Identifier, std::size_t> _ids;
+  std::unordered_multimap<std::uint64_t, std::size_t> _by_content;
+  Pending_list _pending;
+  bool _deduplicate = false;
+  std::size_t _memory_budget = 0; // 0 is unlimited
+  std::size_t _memory_used = 0;
+  std::uint64_t _uses = 0;
 };
 
 template <typename Resource, typename Identifier>
-inline void Resource_holder<Resource, Identifier>::load(Identifier id,
-                                                        const std::string &filename)
+inline Resource_handle<Resource> Resource_holder<Resource, Identifier>::load(Identifier id,
+                                                                             const std::string &filename)
 {
-  std::unique_ptr<Resource> resource(new Resource());
-  if (!resource->loadFromFile(filename))
+  if (Entry *entry = find_entry(id))
+  {
+    ++entry->references;
+    entry->last_used = ++_uses;
+    return handle(id);
+  }
+  auto pending = find_pending(id);
+  if (pending != _pending.end())
+  {
+    ++(*pending)->references;
+    complete(pending);
+    return handle(id);
+  }
+  std::vector<char> content;
+  std::uint64_t content_hash = 0;
+  if (_deduplicate)
+  {
+    if (!read_file(filename, content))
+      throw std::runtime_error("Failed to load " + filename);
+    content_hash = fnv1a_hash(content);
+    if (share_duplicate(id, content_hash, content, 1))
+      return handle(id);
+  }
+  auto staged = std::make_unique<typename Loader::Staged>();
+  bool decoded = _deduplicate ? Loader::decode_memory(*staged, content) : Loader::decode(*staged, filename);
+  std::unique_ptr<Resource> resource;
+  if (!decoded || !(resource = Loader::upload(std::move(staged))))
     throw std::runtime_error("Failed to load " + filename);
-  auto inserted = _resource_map.insert(std::make_pair(id, std::move(resource)));
+  insert(id, std::move(resource), content_hash, std::move(content), 1);
+  return handle(id);
+}
+
+// Takes a resource that was made rather than loaded from a file, with one
+// reference. Throws if 'id' is already in use.
+template <typename Resource, typename Identifier>
+inline Resource_handle<Resource> Resource_holder<Resource, Identifier>::add(Identifier id,
+                                                                            std::unique_ptr<Resource> resource)
+{
+  if (find_entry(id) || find_pending(id) != _pending.end())
+    throw std::runtime_error("Resource id already in use");
+  insert(id, std::move(resource), 0, {}, 1);
+  return handle(id);
+}
+
+template <typename Resource, typename Identifier>
+inline std::shared_future<Resource *> Resource_holder<Resource, Identifier>::load_async(Identifier id,
+                                                                                        const std::string &filename)
+{
+  if (Entry *entry = find_entry(id))
+  {
+    ++entry->references;
+    entry->last_used = ++_uses;
+    std::promise<Resource *> ready;
+    ready.set_value(entry->resource.get());
+    return ready.get_future().share();
+  }
+  auto pending = find_pending(id);
+  if (pending != _pending.end())
+  {
+    ++(*pending)->references;
+    return (*pending)->result;
+  }
+
+  auto p = std::make_shared<Pending>();
+  p->id = id;
+  p->filename = filename;
+  p->deduplicate = _deduplicate;
+  p->staged = std::make_unique<typename Loader::Staged>();
+  p->result = p->loaded.get_future().share();
+  p->decoded = p->decoding.get_future();
+  // The job shares the pending load, so a holder destroyed in the meantime
+  // doesn't pull it from under the loader thread. The main thread leaves
+  // 'staged', 'content' and 'content_hash' alone until 'decoded' is ready.
+  Loader_pool &pool = loader_pool();
+  pool.threads.run([p]
+                   {
+                     if (!p->deduplicate)
+                     {
+                       p->decoding.set_value(Loader::decode(*p->staged, p->filename));
+                       return;
+                     }
+                     bool read = read_file(p->filename, p->content);
+                     if (read)
+                       p->content_hash = fnv1a_hash(p->content);
+                     p->decoding.set_value(read && Loader::decode_memory(*p->staged, p->content));
+                   },
+                   pool.loading);
+  _pending.push_back(p);
+  return p->result;
+}
+
+// Uploads decoded resources, oldest first, until 'budget' has been spent;
+// at least one is finished if any is ready. Returns how many are left.
+template <typename Resource, typename Identifier>
+inline std::size_t Resource_holder<Resource, Identifier>::finish_loads(const Time budget)
+{
+  Clock clock;
+  for (auto it = _pending.begin(); it != _pending.end();)
+  {
+    if ((*it)->decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      ++it;
+      continue;
+    }
+    std::shared_ptr<Pending> p = *it;
+    it = _pending.erase(it);
+    finish(*p);
+    if (clock.getElapsedTime() >= budget)
+      break;
+  }
+  return _pending.size();
+}
+
+// Gives back a reference taken by load() or load_async(). The resource stays
+// loaded, but may be evicted once nothing references it.
+template <typename Resource, typename Identifier>
+inline void Resource_holder<Resource, Identifier>::release(Identifier id)
+{
+  auto pending = find_pending(id);
+  if (pending != _pending.end() && (*pending)->references > 0)
+    --(*pending)->references;
+  else if (Entry *entry = find_entry(id))
+  {
+    if (entry->references > 0)
+      --entry->references;
+    evict();
+  }
+}
+
+// The handle of a loaded id, or an invalid handle
+template <typename Resource, typename Identifier>
+inline Resource_handle<Resource> Resource_holder<Resource, Identifier>::handle(Identifier id) const
+{
+  auto found = _ids.find(id);
+  if (found == _ids.end())
+    return Handle{};
+  return Handle{std::uint32_t(found->second), _entries[found->second].generation};
+}
+
+template <typename Resource, typename Identifier>
+inline bool Resource_holder<Resource, Identifier>::is_loaded(Identifier id) const
+{
+  return find_entry(id) != nullptr;
+}
+
+// False once the resource has been evicted
+template <typename Resource, typename Identifier>
+inline bool Resource_holder<Resource, Identifier>::is_loaded(const Handle handle) const
+{
+  return handle.valid() && handle.index < _entries.size() &&
+         _entries[handle.index].generation == handle.generation && _entries[handle.index].resource;
+}
+
+template <typename Resource, typename Identifier>
+inline std::size_t Resource_holder<Resource, Identifier>::pending_loads() const
+{
+  return _pending.size();
+}
+
+// References to the resource of 'id', which other ids may share
+template <typename Resource, typename Identifier>
+inline int Resource_holder<Resource, Identifier>::references(Identifier id) const
+{
+  const Entry *entry = find_entry(id);
+  return entry ? entry->references : 0;
 }
 
 template <typename Resource, typename Identifier>
 inline Resource &Resource_holder<Resource, Identifier>::get(Identifier id)
 {
-  auto found = _resource_map.find(id);
-  assert(found != _resource_map.end());
-  return *found->second;
+  Entry *entry = find_entry(id);
+  if (!entry)
+  {
+    auto pending = find_pending(id);
+    if (pending != _pending.end())
+    {
+      complete(pending);
+      entry = find_entry(id);
+    }
+  }
+  if (!entry)
+    throw std::runtime_error("Resource not loaded");
+  entry->last_used = ++_uses;
+  return *entry->resource;
 }
 
 template <typename Resource, typename Identifier>
 inline const Resource &Resource_holder<Resource, Identifier>::get(Identifier id) const
 {
-  auto found = _resource_map.find(id);
-  assert(found != _resource_map.end());
-  return *found->second;
+  const Entry *entry = find_entry(id);
+  if (!entry)
+    throw std::runtime_error("Resource not loaded");
+  return *entry->resource;
+}
+
+template <typename Resource, typename Identifier>
+inline Resource &Resource_holder<Resource, Identifier>::get(const Handle handle)
+{
+  if (!is_loaded(handle))
+    throw std::runtime_error("Resource handle is stale");
+  Entry &entry = _entries[handle.index];
+  entry.last_used = ++_uses;
+  return *entry.resource;
+}
+
+template <typename Resource, typename Identifier>
+inline const Resource &Resource_holder<Resource, Identifier>::get(const Handle handle) const
+{
+  if (!is_loaded(handle))
+    throw std::runtime_error("Resource handle is stale");
+  return *_entries[handle.index].resource;
+}
+
+template <typename Resource, typename Identifier>
+inline void Resource_holder<Resource, Identifier>::set_deduplication(const bool enabled)
+{
+  _deduplicate = enabled;
+}
+
+template <typename Resource, typename Identifier>
+inline void Resource_holder<Resource, Identifier>::set_memory_budget(const std::size_t bytes)
+{
+  _memory_budget = bytes;
+  evict();
+}
+
+template <typename Resource, typename Identifier>
+inline std::size_t Resource_holder<Resource, Identifier>::memory_used() const
+{
+  return _memory_used;
+}
+
+template <typename Resource, typename Identifier>
+inline typename Resource_holder<Resource, Identifier>::Entry *
+Resource_holder<Resource, Identifier>::find_entry(const Identifier &id)
+{
+  auto found = _ids.find(id);
+  return found == _ids.end() ? nullptr : &_entries[found->second];
+}
+
+template <typename Resource, typename Identifier>
+inline const typename Resource_holder<Resource, Identifier>::Entry *
+Resource_holder<Resource, Identifier>::find_entry(const Identifier &id) const
+{
+  auto found = _ids.find(id);
+  return found == _ids.end() ? nullptr : &_entries[found->second];
+}
+
+template <typename Resource, typename Identifier>
+inline typename Resource_holder<Resource, Identifier>::Pending_list::iterator
+Resource_holder<Resource, Identifier>::find_pending(const Identifier &id)
+{
+  return std::find_if(_pending.begin(), _pending.end(),
+                      [&id](const std::shared_ptr<Pending> &p)
+                      { return p->id == id; });
+}
+
+// Finishes a pending load now, waiting for its decoding if needed;
+// rethrows if it failed
+template <typename Resource, typename Identifier>
+inline void Resource_holder<Resource, Identifier>::complete(typename Pending_list::iterator pending)
+{
+  std::shared_ptr<Pending> p = *pending;
+  _pending.erase(pending);
+  finish(*p);
+  p->result.get();
+}
+
+// Waits for 'pending' to be decoded, then uploads it and fulfils its future
+template <typename Resource, typename Identifier>
+inline void Resource_holder<Resource, Identifier>::finish(Pending &pending)
+{
+  bool decoded = pending.decoded.get();
+  if (decoded && pending.content_hash)
+  {
+    if (Resource *shared = share_duplicate(pending.id, pending.content_hash, pending.content, pending.references))
+    {
+      pending.loaded.set_value(shared);
+      return;
+    }
+  }
+  std::unique_ptr<Resource> resource;
+  if (decoded)
+    resource = Loader::upload(std::move(pending.staged));
+  if (!resource)
+  {
+    pending.loaded.set_exception(std::make_exception_ptr(
+        std::runtime_error("Failed to load " + pending.filename)));
+    return;
+  }
+  pending.loaded.set_value(insert(pending.id, std::move(resource), pending.content_hash,
+                                  std::move(pending.content), pending.references));
+}
+
+// Points 'id' at an already loaded resource whose file had the same bytes,
+// if any
+template <typename Resource, typename Identifier>
+inline Resource *Resource_holder<Resource, Identifier>::share_duplicate(const Identifier &id,
+                                                                       const std::uint64_t content_hash,
+                                                                       const std::vector<char> &content,
+                                                                       const int references)
+{
+  auto candidates = _by_content.equal_range(content_hash);
+  for (auto found = candidates.first; found != candidates.second; ++found)
+  {
+    Entry &entry = _entries[found->second];
+    if (entry.content != content)
+      continue;
+    entry.references += references;
+    entry.last_used = ++_uses;
+    _ids[id] = found->second;
+    return entry.resource.get();
+  }
+  return nullptr;
+}
+
+template <typename Resource, typename Identifier>
+inline Resource *Resource_holder<Resource, Identifier>::insert(const Identifier &id,
+                                                              std::unique_ptr<Resource> resource,
+                                                              const std::uint64_t content_hash,
+                                                              std::vector<char> content,
+                                                              const int references)
+{
+  std::size_t index = _entries.size();
+  if (_free_entries.empty())
+    _entries.emplace_back();
+  else
+  {
+    index = _free_entries.back();
+    _free_entries.pop_back();
+  }
+  Entry &entry = _entries[index];
+  ++entry.generation;
+  entry.bytes = Loader::size_of(*resource) + content.size();
+  entry.resource = std::move(resource);
+  entry.content_hash = content_hash;
+  entry.content = std::move(content);
+  entry.references = references;
+  entry.last_used = ++_uses;
+  _ids[id] = index;
+  if (content_hash)
+    _by_content.emplace(content_hash, index);
+  _memory_used += entry.bytes;
+  Resource *inserted = entry.resource.get();
+  evict();
+  return inserted;
+}
+
+// Drops unreferenced resources, least recently used first, until the
+// memory budget is met
+template <typename Resource, typename Identifier>
+inline void Resource_holder<Resource, Identifier>::evict()
+{
+  while (_memory_budget != 0 && _memory_used > _memory_budget)
+  {
+    std::size_t victim = _entries.size();
+    for (std::size_t i = 0; i < _entries.size(); ++i)
+    {
+      const Entry &e = _entries[i];
+      if (e.resource && e.references == 0 &&
+          (victim == _entries.size() || e.last_used < _entries[victim].last_used))
+        victim = i;
+    }
+    if (victim == _entries.size())
+      return;
+    Entry &entry = _entries[victim];
+    _memory_used -= entry.bytes;
+    auto candidates = _by_content.equal_range(entry.content_hash);
+    for (auto it = candidates.first; it != candidates.second; ++it)
+    {
+      if (it->second == victim)
+      {
+        _by_content.erase(it);
+        break;
+      }
+    }
+    for (auto it = _ids.begin(); it != _ids.end();)
+    {
+      if (it->second == victim)
+        it = _ids.erase(it);
+      else
+        ++it;
+    }
+    entry.resource.reset();
+    entry.content = std::vector<char>();
+    _free_entries.push_back(victim);
+  }
+}
+
+// Mipmaps
+
+// Halves an RGBA image with a 2x2 box filter, rounding sizes down: an odd
+// side drops its last row or column, and a 1 pixel wide side stays 1 pixel
+// wide by averaging each pixel with itself.
+inline sf::Image downsample(const sf::Image &image)
+{
+  const unsigned int w = image.getSize().x;
+  const unsigned int h = image.getSize().y;
+  const unsigned int dw = std::max(w / 2, 1u);
+  const unsigned int dh = std::max(h / 2, 1u);
+  const sf::Uint8 *src = image.getPixelsPtr();
+  std::vector<sf::Uint8> dst(size_t(dw) * dh * 4);
+  for (unsigned int y = 0; y < dh; ++y)
+  {
+    const sf::Uint8 *row0 = src + size_t(std::min(2 * y, h - 1)) * w * 4;
+    const sf::Uint8 *row1 = src + size_t(std::min(2 * y + 1, h - 1)) * w * 4;
+    sf::Uint8 *out = &dst[size_t(y) * dw * 4];
+    unsigned int x = 0;
+#ifdef BASIX_SSE2
+    // Four output pixels per iteration, from 8 pixels of each source row
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for (; 2 * (x + 4) <= w; x += 4)
+    {
+      __m128i packed[2];
+      for (int half = 0; half < 2; ++half)
+      {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 8 * x + 16 * half));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 8 * x + 16 * half));
+        // Vertical sums of pixels 0,1 and 2,3 in 16 bits per channel
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        // Horizontal sums of each pair land in the low 64 bits
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        packed[half] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * x), _mm_packus_epi16(packed[0], packed[1]));
+    }
+#endif
+    for (; x < dw; ++x)
+    {
+      const unsigned int x0 = std::min(2 * x, w - 1);
+      const unsigned int x1 = std::min(2 * x + 1, w - 1);
+      for (int c = 0; c < 4; ++c)
+      {
+        out[4 * x + c] = sf::Uint8((row0[4 * x0 + c] + row0[4 * x1 + c] +
+                                    row1[4 * x0 + c] + row1[4 * x1 + c] + 2) / 4);
+      }
+    }
+  }
+  sf::Image result;
+  result.create(dw, dh, dst.data());
+  return result;
+}
+
+// Returns 'image' followed by its successive halvings, down to 1x1
+inline std::vector<sf::Image> build_mip_chain(const sf::Image &image)
+{
+  std::vector<sf::Image> levels{image};
+  while (levels.back().getSize().x > 1 || levels.back().getSize().y > 1)
+  {
+    levels.push_back(downsample(levels.back()));
+  }
+  return levels;
 }
 
+// A texture loaded together with its mip chain
+//
+// The GPU copy gets mipmaps (sf::Texture::generateMipmap), so sprites
+// drawn smaller than their texture sample a matching level instead of
+// aliasing. The CPU copies of every level are kept too: SFML can't read
+// levels back from the GPU, and the software rasterizer builds its own
+// textures from them (see e3d::Texture). They count against texture_holder's
+// memory budget, so unreferenced textures still get evicted.
+class Mipmapped_texture : public Texture
+{
+ public:
+  bool loadFromFile(const std::string &filename);
+  bool loadFromImage(const sf::Image &image);
+  bool load_mip_chain(std::vector<sf::Image> levels);
+  const std::vector<sf::Image> &mip_levels() const;
+
+ private:
+  std::vector<sf::Image> levels_;
+};
+
+inline bool Mipmapped_texture::loadFromFile(const std::string &filename)
+{
+  sf::Image image;
+  return image.loadFromFile(filename) && loadFromImage(image);
+}
+
+inline bool Mipmapped_texture::loadFromImage(const sf::Image &image)
+{
+  return load_mip_chain(build_mip_chain(image));
+}
+
+// Uploads a chain made by build_mip_chain
+inline bool Mipmapped_texture::load_mip_chain(std::vector<sf::Image> levels)
+{
+  if (levels.empty() || !Texture::loadFromImage(levels.front()))
+    return false;
+  generateMipmap();
+  levels_ = std::move(levels);
+  return true;
+}
+
+inline const std::vector<sf::Image> &Mipmapped_texture::mip_levels() const
+{
+  return levels_;
+}
+
+// Textures are decoded and filtered on the loader thread, but only the main
+// thread talks to the GPU
+template <>
+struct Resource_loader<Mipmapped_texture>
+{
+  using Staged = std::vector<sf::Image>;
+
+  static bool decode(Staged &levels, const std::string &filename)
+  {
+    sf::Image image;
+    if (!image.loadFromFile(filename))
+      return false;
+    levels = build_mip_chain(image);
+    return true;
+  }
+
+  static bool decode_memory(Staged &levels, const std::vector<char> &bytes)
+  {
+    sf::Image image;
+    if (!image.loadFromMemory(bytes.data(), bytes.size()))
+      return false;
+    levels = build_mip_chain(image);
+    return true;
+  }
+
+  static std::unique_ptr<Mipmapped_texture> upload(std::unique_ptr<Staged> levels)
+  {
+    auto texture = std::make_unique<Mipmapped_texture>();
+    if (!texture->load_mip_chain(std::move(*levels)))
+      return nullptr;
+    return texture;
+  }
+
+  // The CPU copies of the levels, plus as much again on the GPU
+  static std::size_t size_of(const Mipmapped_texture &texture)
+  {
+    std::size_t bytes = sizeof(texture);
+    for (const sf::Image &level : texture.mip_levels())
+      bytes += 2 * std::size_t(level.getSize().x) * level.getSize().y * 4;
+    return bytes;
+  }
+};
+
 using Identifier = std::string;
 
-static Resource_holder<Texture, Identifier> texture_holder{};
+static Resource_holder<Mipmapped_texture, Identifier> texture_holder{};
 static Resource_holder<Font, Identifier> font_holder{};
 static Resource_holder<sf::SoundBuffer, Identifier> sound_buffer_holder{};
 
+// Finishes the asynchronous loads of all holders, spending at most about
+// 'budget' of the frame; returns how many are still pending
+inline std::size_t finish_loads(const Time budget = milliseconds(4))
+{
+  Clock clock;
+  std::size_t pending = texture_holder.finish_loads(budget);
+  pending += font_holder.finish_loads(budget - clock.getElapsedTime());
+  pending += sound_buffer_holder.finish_loads(budget - clock.getElapsedTime());
+  return pending;
+}
+
+// Texture atlas
+
+// Where a packed image ended up: a page in texture_holder and a rectangle on it
+struct Atlas_region
+{
+  Resource_handle<Mipmapped_texture> page;
+  sf::IntRect rect;
+};
+
+// Packs many small images into a few large textures
+//
+// Sprites drawn from one texture can be batched into a single draw call, so
+// packing every sprite and animation sheet into a couple of pages cuts the
+// draw calls of a scene to a handful. Pages are added to texture_holder, and
+// Sprite and AnimatedSprite look their file name up in sprite_atlas first:
+// when it's there they use its page and rectangle instead of loading the
+// file, with no change to the calling code.
+//
+// An atlas can be packed at run time,
+//
+//     sprite_atlas.add_file("hero.png", "hero.png");
+//     sprite_atlas.add_file("wall.png", "wall.png");
+//     sprite_atlas.pack();
+//
+// or ahead of time with tools/atlas, and then loaded:
+//
+//     sprite_atlas.load("sprites");    // sprites.atlas, sprites_0.png, ...
+//
+// Images are packed with the skyline packer of stb_rect_pack, leaving
+// 'padding' pixels between them so that filtering doesn't bleed across.
+class Texture_atlas
+{
+ public:
+  explicit Texture_atlas(const std::string &name = "atlas",
+                         const unsigned int page_size = 2048,
+                         const unsigned int padding = 2);
+  Texture_atlas(const Texture_atlas &) = delete;
+  Texture_atlas &operator=(const Texture_atlas &) = delete;
+  ~Texture_atlas();
+  void add(const Identifier &id, const sf::Image &image);
+  void add_file(const Identifier &id, const std::string &filename);
+  bool pack(const bool upload_pages = true);
+  bool save(const std::string &prefix) const;
+  bool load(const std::string &prefix);
+  bool contains(const Identifier &id) const;
+  const Atlas_region &region(const Identifier &id) const;
+  std::size_t page_count() const;
+  const sf::Image &page_image(const std::size_t page) const;
+
+ private:
+  struct Placement
+  {
+    std::size_t page;
+    sf::IntRect rect;
+  };
+
+  bool upload(const std::string &prefix);
+
+  std::string _name;
+  unsigned int _page_size;
+  unsigned int _padding;
+  int _packs = 0;
+  std::vector<std::pair<Identifier, sf::Image>> _images;
+  std::vector<sf::Image> _pages;
+  std::vector<std::string> _page_files; // set by load()
+  std::vector<Identifier> _page_ids;     // pages referenced in texture_holder
+  std::unordered_map<Identifier, Placement> _placements;
+  std::unordered_map<Identifier, Atlas_region> _regions;
+};
+
+inline Texture_atlas::Texture_atlas(const std::string &name,
+                                    const unsigned int page_size,
+                                    const unsigned int padding)
+    : _name{name}, _page_size{page_size}, _padding{padding}
+{
+}
+
+inline Texture_atlas::~Texture_atlas()
+{
+  for (const Identifier &id : _page_ids)
+    texture_holder.release(id);
+}
+
+// Queues an image for the next pack()
+inline void Texture_atlas::add(const Identifier &id, const sf::Image &image)
+{
+  _images.emplace_back(id, image);
+}
+
+inline void Texture_atlas::add_file(const Identifier &id, const std::string &filename)
+{
+  sf::Image image;
+  if (!image.loadFromFile(filename))
+    throw std::runtime_error("Failed to load " + filename);
+  add(id, image);
+}
+
+// Packs every image added so far into as many pages as needed, largest
+// images first, and adds the pages to texture_holder unless 'upload_pages'
+// is false (to only save() them). False if an image doesn't fit in a page
+// or a page can't be uploaded.
+inline bool Texture_atlas::pack(const bool upload_pages)
+{
+  std::vector<stbrp_rect> rects(_images.size());
+  for (std::size_t i = 0; i < _images.size(); ++i)
+  {
+    sf::Vector2u size = _images[i].second.getSize();
+    if (size.x + _padding > _page_size || size.y + _padding > _page_size)
+      return false;
+    rects[i].id = int(i);
+    rects[i].w = stbrp_coord(size.x + _padding);
+    rects[i].h = stbrp_coord(size.y + _padding);
+    rects[i].was_packed = 0;
+  }
+  std::vector<Placement> placements(_images.size());
+  std::vector<sf::Vector2u> extents;
+  std::vector<stbrp_node> nodes(_page_size);
+  while (!rects.empty())
+  {
+    stbrp_context context;
+    stbrp_init_target(&context, int(_page_size), int(_page_size), nodes.data(), int(nodes.size()));
+    stbrp_pack_rects(&context, rects.data(), int(rects.size()));
+    sf::Vector2u extent{0, 0};
+    std::vector<stbrp_rect> left;
+    for (const stbrp_rect &r : rects)
+    {
+      if (!r.was_packed)
+      {
+        left.push_back(r);
+        continue;
+      }
+      sf::Vector2u size = _images[r.id].second.getSize();
+      placements[r.id] = Placement{extents.size(), sf::IntRect(r.x, r.y, int(size.x), int(size.y))};
+      extent.x = std::max(extent.x, unsigned(r.x) + size.x);
+      extent.y = std::max(extent.y, unsigned(r.y) + size.y);
+    }
+    extents.push_back(extent);
+    rects.swap(left);
+  }
+
+  // Each page is cropped to what was packed on it
+  _pages.assign(extents.size(), sf::Image{});
+  for (std::size_t page = 0; page < extents.size(); ++page)
+    _pages[page].create(std::max(extents[page].x, 1u), std::max(extents[page].y, 1u), Color::Transparent);
+  _placements.clear();
+  for (std::size_t i = 0; i < _images.size(); ++i)
+  {
+    const Placement &placement = placements[i];
+    _pages[placement.page].copy(_images[i].second, unsigned(placement.rect.left), unsigned(placement.rect.top));
+    _placements[_images[i].first] = placement;
+  }
+  _page_files.clear();
+  _regions.clear();
+  return !upload_pages || upload(_name + "#" + std::to_string(++_packs) + "/");
+}
+
+// Writes the pages as PNG files next to a manifest, '<prefix>.atlas', that
+// lists one page file per "page" line and one image per "region" line:
+//
+//     page sprites_0.png
+//     region 0 12 0 32 48 hero.png
+//
+// (page index, left, top, width, height, then the id up to the end of line)
+inline bool Texture_atlas::save(const std::string &prefix) const
+{
+  std::ofstream manifest(prefix + ".atlas");
+  if (!manifest)
+    return false;
+  std::string base = prefix.substr(prefix.find_last_of("/\\") + 1);
+  for (std::size_t page = 0; page < _pages.size(); ++page)
+  {
+    std::string file = prefix + "_" + std::to_string(page) + ".png";
+    if (!_pages[page].saveToFile(file))
+      return false;
+    manifest << "page " << base << "_" << page << ".png\n";
+  }
+  for (const auto &image : _images)
+  {
+    const Placement &p = _placements.at(image.first);
+    manifest << "region " << p.page << " " << p.rect.left << " " << p.rect.top << " "
+             << p.rect.width << " " << p.rect.height << " " << image.first << "\n";
+  }
+  return bool(manifest);
+}
+
+// Replaces the atlas with one written by save(); page files are looked up
+// next to the manifest
+inline bool Texture_atlas::load(const std::string &prefix)
+{
+  std::ifstream manifest(prefix + ".atlas");
+  if (!manifest)
+    return false;
+  std::string dir = prefix.substr(0, prefix.find_last_of("/\\") + 1);
+  std::vector<sf::Image> pages;
+  std::vector<std::string> files;
+  std::unordered_map<Identifier, Placement> placements;
+  std::string line;
+  while (std::getline(manifest, line))
+  {
+    std::istringstream fields(line);
+    std::string kind;
+    if (!(fields >> kind) || kind[0] == '#')
+      continue;
+    if (kind == "page")
+    {
+      std::string file;
+      fields >> std::ws;
+      std::getline(fields, file);
+      pages.emplace_back();
+      files.push_back(dir + file);
+      if (!pages.back().loadFromFile(files.back()))
+        return false;
+    }
+    else if (kind == "region")
+    {
+      Placement p;
+      std::string id;
+      if (!(fields >> p.page >> p.rect.left >> p.rect.top >> p.rect.width >> p.rect.height) ||
+          p.page >= pages.size())
+        return false;
+      fields >> std::ws;
+      std::getline(fields, id);
+      placements[id] = p;
+    }
+    else
+      return false;
+  }
+  _images.clear();
+  _pages.swap(pages);
+  _page_files.swap(files);
+  _placements.swap(placements);
+  return upload("");
+}
+
+inline bool Texture_atlas::contains(const Identifier &id) const
+{
+  return _regions.count(id) != 0;
+}
+
+inline const Atlas_region &Texture_atlas::region(const Identifier &id) const
+{
+  auto found = _regions.find(id);
+  assert(found != _regions.end());
+  return found->second;
+}
+
+inline std::size_t Texture_atlas::page_count() const
+{
+  return _pages.size();
+}
+
+inline const sf::Image &Texture_atlas::page_image(const std::size_t page) const
+{
+  return _pages[page];
+}
+
+// Adds the pages to texture_holder, under their file names if they have
+// them or under 'prefix' and their index, and points the regions at them.
+// The atlas holds one reference to each page, and gives back those of the
+// previous pages once the new ones are in, so that repacking doesn't leak
+// them. False if a page can't be uploaded, leaving the atlas without regions.
+inline bool Texture_atlas::upload(const std::string &prefix)
+{
+  _regions.clear();
+  std::vector<Identifier> ids;
+  std::vector<Resource_handle<Mipmapped_texture>> handles;
+  bool uploaded = true;
+  for (std::size_t page = 0; page < _pages.size(); ++page)
+  {
+    Identifier id = page < _page_files.size() ? _page_files[page] : prefix + std::to_string(page);
+    if (texture_holder.is_loaded(id))
+      handles.push_back(texture_holder.load(id, id));
+    else
+    {
+      auto texture = std::make_unique<Mipmapped_texture>();
+      if (!texture->loadFromImage(_pages[page]))
+      {
+        uploaded = false;
+        break;
+      }
+      handles.push_back(texture_holder.add(id, std::move(texture)));
+    }
+    ids.push_back(id);
+  }
+  for (const Identifier &id : _page_ids)
+    texture_holder.release(id);
+  _page_ids.swap(ids);
+  if (!uploaded)
+    return false;
+  for (const auto &placement : _placements)
+    _regions[placement.first] = Atlas_region{handles[placement.second.page], placement.second.rect};
+  return true;
+}
+
+// Atlas that Sprite and AnimatedSprite look their files up in
+static Texture_atlas sprite_atlas{"sprite_atlas"};
+
 // Window class
 
 class Point : public sf::Vector2f
@@ -403,8 +1590,14 @@ inline Sprite::Sprite() : sf::Sprite() {}
 
 inline Sprite::Sprite(const std::string &filename)
 {
-  texture_holder.load(filename, filename);
-  setTexture(texture_holder.get(filename), true);
+  if (sprite_atlas.contains(filename))
+  {
+    const Atlas_region &region = sprite_atlas.region(filename);
+    setTexture(texture_holder.get(region.page));
+    setTextureRect(region.rect);
+  }
+  else
+    setTexture(texture_holder.get(texture_holder.load(filename, filename)), true);
   setOrigin(getLocalBounds().width / 2,
             getLocalBounds().height / 2);
 }
@@ -443,6 +1636,8 @@ struct Animation
 {
   std::string id;
   std::string sprite_sheet;
+  Resource_handle<Mipmapped_texture> texture;
+  sf::Vector2i sheet_position; // top left corner, when the sheet is in an atlas
   sf::Vector2i sheet_dimensions;
   sf::Vector2i frame_size;
   Time frame_duration;
@@ -456,7 +1651,7 @@ inline sf::IntRect Animation::operator[](const int index) const
 {
   int x = index % sheet_dimensions.x;
   int y = index / sheet_dimensions.x;
-  return sf::IntRect{sf::Vector2i{x * frame_size.x, y * frame_size.y}, frame_size};
+  return sf::IntRect{sheet_position + sf::Vector2i{x * frame_size.x, y * frame_size.y}, frame_size};
 }
 
 inline sf::IntRect Animation::operator[](const Time elapsed) const
@@ -530,13 +1725,27 @@ inline void AnimatedSprite::addAnimation(const std::string &id,
                                   const sf::Vector2i sheet_dimensions,
                                   const Time frame_duration)
 {
-  texture_holder.load(sprite_sheet, sprite_sheet);
-  Texture &sheet{texture_holder.get(sprite_sheet)};
-  sf::Vector2u sheet_size = sheet.getSize();
+  Resource_handle<Mipmapped_texture> texture;
+  sf::Vector2i sheet_position{0, 0};
+  sf::Vector2u sheet_size;
+  if (sprite_atlas.contains(sprite_sheet))
+  {
+    const Atlas_region &region = sprite_atlas.region(sprite_sheet);
+    texture = region.page;
+    sheet_position = sf::Vector2i{region.rect.left, region.rect.top};
+    sheet_size = sf::Vector2u(region.rect.width, region.rect.height);
+  }
+  else
+  {
+    texture = texture_holder.load(sprite_sheet, sprite_sheet);
+    sheet_size = texture_holder.get(texture).getSize();
+  }
   int frame_size_x = sheet_size.x / sheet_dimensions.x;
   int frame_size_y = sheet_size.y / sheet_dimensions.y;
   animations[id] = Animation{id,
     sprite_sheet,
+    texture,
+    sheet_position,
     sheet_dimensions,
     sf::Vector2i{frame_size_x, frame_size_y},
     frame_duration};
@@ -544,25 +1753,27 @@ inline void AnimatedSprite::addAnimation(const std::string &id,
 
 inline void AnimatedSprite::activateAnimation(const std::string &id)
 {
+  const Animation &animation = animations[id];
   state = AnimationState::Stopped;
   activeAnimation = id;
   elapsedSinceStart = sf::milliseconds(0);
-  frame = sf::IntRect{{0, 0}, animations[id].frame_size};
-  setTexture(texture_holder.get(animations[id].sprite_sheet));
+  frame = animation[0];
+  setTexture(texture_holder.get(animation.texture));
   setOrigin(0, 0);
   setTextureRect(frame);
-  setOrigin(animations[id].frame_size.x / 2, animations[id].frame_size.y / 2);
+  setOrigin(animation.frame_size.x / 2, animation.frame_size.y / 2);
 }
 
 inline void AnimatedSprite::play(const std::string &id, bool repeat)
 {
+  const Animation &animation = animations[id];
   activeAnimation = id;
   elapsedSinceStart = sf::milliseconds(0);
-  frame = sf::IntRect{{0, 0}, animations[id].frame_size};
-  setTexture(texture_holder.get(animations[id].sprite_sheet));
+  frame = animation[0];
+  setTexture(texture_holder.get(animation.texture));
   setOrigin(0, 0);
   setTextureRect(frame);
-  setOrigin(animations[id].frame_size.x / 2, animations[id].frame_size.y / 2);
+  setOrigin(animation.frame_size.x / 2, animation.frame_size.y / 2);
   state = AnimationState::Playing;
   loop = repeat;
 }
@@ -593,7 +1804,7 @@ inline void AnimatedSprite::update(const Time elapsed_time)
 {
   if (activeAnimation != "")
   {
-    Animation curAnim = animations[activeAnimation];
+    const Animation &curAnim = animations[activeAnimation];
     if (state == AnimationState::Playing)
     {
       elapsedSinceStart += elapsed_time;
@@ -614,31 +1825,327 @@ inline void AnimatedSprite::update(const Time elapsed_time)
   }
 }
 
-inline bool AnimatedSprite::isPlayingAnimation() const
+inline bool AnimatedSprite::isPlayingAnimation() const
+{
+  return state == AnimationState::Playing;
+}
+
+inline std::string AnimatedSprite::getPlayingAnimation() const
+{
+  if (isPlayingAnimation())
+  {
+    return activeAnimation;
+  }
+  else
+  {
+    return "";
+  }
+}
+
+inline bool AnimatedSprite::isPlayingAnimation(const std::string& id) const
+{
+  return state == AnimationState::Playing && activeAnimation == id;
+}
+
+inline std::string AnimatedSprite::getActiveAnimation() const
+{
+  return activeAnimation;
+}
+
+// Sprite batch
+
+// Draws many sprites with one draw call per texture
+//
+// Every window.draw(sprite) is a draw call of its own. A batch instead
+// collects the quads of the sprites added to it and, when drawn, sorts them
+// by layer and then by texture, and draws each run of quads that share a
+// texture from a single vertex array. Sprites packed into a Texture_atlas
+// share their page's texture, so a whole scene can take a handful of calls:
+//
+//     Sprite_batch batch;
+//     for (const Sprite &cell : cells)
+//       batch.add(cell);
+//     batch.add(hero, 1);
+//     window.draw(batch);
+//     batch.clear();
+//
+// Lower layers are drawn first. Within a layer, sprites with the same
+// texture keep the order they were added in, but sprites with different
+// textures may be reordered, so sprites that overlap should go on different
+// layers.
+class Sprite_batch : public sf::Drawable
+{
+ public:
+  void add(const sf::Sprite &sprite, const int layer = 0);
+  void add(const sf::Texture &texture, const sf::IntRect &texture_rect,
+           const sf::Transform &transform, const Color &color = Color::White,
+           const int layer = 0);
+  void clear();
+  std::size_t size() const;
+  std::size_t draw_calls() const;
+
+ private:
+  struct Quad
+  {
+    int layer;
+    const sf::Texture *texture;
+    std::size_t order;
+    sf::Vertex vertices[4];
+  };
+
+  struct Batch
+  {
+    const sf::Texture *texture;
+    std::size_t first; // vertex index
+    std::size_t count;
+  };
+
+  void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+  void sort() const;
+
+  std::vector<Quad> _quads;
+  mutable std::vector<sf::Vertex> _vertices;
+  mutable std::vector<Batch> _batches;
+  mutable bool _sorted = true;
+};
+
+inline void Sprite_batch::add(const sf::Sprite &sprite, const int layer)
+{
+  if (sprite.getTexture())
+    add(*sprite.getTexture(), sprite.getTextureRect(), sprite.getTransform(), sprite.getColor(), layer);
+}
+
+inline void Sprite_batch::add(const sf::Texture &texture, const sf::IntRect &texture_rect,
+                              const sf::Transform &transform, const Color &color,
+                              const int layer)
+{
+  // Same corners and texture coordinates as sf::Sprite
+  float left = float(texture_rect.left);
+  float top = float(texture_rect.top);
+  float right = left + float(texture_rect.width);
+  float bottom = top + float(texture_rect.height);
+  float width = std::abs(float(texture_rect.width));
+  float height = std::abs(float(texture_rect.height));
+  Quad quad{layer, &texture, _quads.size(), {}};
+  quad.vertices[0] = sf::Vertex(transform.transformPoint(0, 0), color, Vector2f(left, top));
+  quad.vertices[1] = sf::Vertex(transform.transformPoint(0, height), color, Vector2f(left, bottom));
+  quad.vertices[2] = sf::Vertex(transform.transformPoint(width, height), color, Vector2f(right, bottom));
+  quad.vertices[3] = sf::Vertex(transform.transformPoint(width, 0), color, Vector2f(right, top));
+  _quads.push_back(quad);
+  _sorted = false;
+}
+
+inline void Sprite_batch::clear()
+{
+  _quads.clear();
+  _sorted = false;
+}
+
+inline std::size_t Sprite_batch::size() const
+{
+  return _quads.size();
+}
+
+// Draw calls the batch makes when drawn
+inline std::size_t Sprite_batch::draw_calls() const
+{
+  sort();
+  return _batches.size();
+}
+
+inline void Sprite_batch::draw(sf::RenderTarget &target, sf::RenderStates states) const
+{
+  sort();
+  for (const Batch &batch : _batches)
+  {
+    states.texture = batch.texture;
+    target.draw(&_vertices[batch.first], batch.count, sf::Quads, states);
+  }
+}
+
+// Orders the quads by layer, texture and insertion, and splits them into
+// runs of one texture
+inline void Sprite_batch::sort() const
+{
+  if (_sorted)
+    return;
+  std::vector<const Quad *> order(_quads.size());
+  for (std::size_t i = 0; i < _quads.size(); ++i)
+    order[i] = &_quads[i];
+  std::sort(order.begin(), order.end(),
+            [](const Quad *a, const Quad *b)
+            {
+              if (a->layer != b->layer)
+                return a->layer < b->layer;
+              if (a->texture != b->texture)
+                return std::less<const sf::Texture *>()(a->texture, b->texture);
+              return a->order < b->order;
+            });
+  _vertices.clear();
+  _batches.clear();
+  for (const Quad *quad : order)
+  {
+    if (_batches.empty() || _batches.back().texture != quad->texture)
+      _batches.push_back(Batch{quad->texture, _vertices.size(), 0});
+    _vertices.insert(_vertices.end(), quad->vertices, quad->vertices + 4);
+    _batches.back().count += 4;
+  }
+  _sorted = true;
+}
+
+// Tile layer
+
+// A grid of textured tiles baked into one vertex buffer
+//
+// For static scenery, like the cells of a maze, that changes far less often
+// than it is drawn. Changing a tile rewrites only its four vertices, and only
+// the span of tiles changed since the last draw is uploaded to the GPU, so a
+// frame with no changes costs one draw call and no uploads whatever the size
+// of the grid. All tiles share one texture; with a Texture_atlas they can
+// still show different images.
+//
+//     Tile_layer layer{Vector2i{rows, cols}, Vector2f{32, 32}, Vector2f{0, 0}};
+//     layer.set_texture(&texture_holder.get(page));
+//     layer.set_tile(cell, sprite_atlas.region("wall.png").rect);
+//     window.draw(layer);
+//
+// Tiles are numbered row by row from the top left corner.
+class Tile_layer : public sf::Drawable
+{
+ public:
+  Tile_layer() = default;
+  Tile_layer(const Vector2i dimension, const Vector2f tile_size, const Vector2f topleft);
+  void resize(const Vector2i dimension, const Vector2f tile_size, const Vector2f topleft);
+  void set_texture(const sf::Texture *texture);
+  void set_tile(const int index, const sf::IntRect &texture_rect);
+  void set_color(const int index, const Color &color);
+  std::size_t tile_count() const;
+  std::size_t dirty_tiles() const;
+  const sf::Vertex *tile_vertices(const int index) const;
+
+ private:
+  void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+  void mark_dirty(const std::size_t index);
+
+  Vector2i dimension_{0, 0}; // {rows, cols}
+  const sf::Texture *texture_ = nullptr;
+  std::vector<sf::Vertex> vertices_;
+  mutable std::unique_ptr<sf::VertexBuffer> buffer_;
+  mutable std::size_t dirty_begin_ = 0; // tiles to upload, [begin, end)
+  mutable std::size_t dirty_end_ = 0;
+};
+
+inline Tile_layer::Tile_layer(const Vector2i dimension, const Vector2f tile_size, const Vector2f topleft)
+{
+  resize(dimension, tile_size, topleft);
+}
+
+// Lays out rows x cols blank tiles; the whole grid is uploaded on next draw
+inline void Tile_layer::resize(const Vector2i dimension, const Vector2f tile_size, const Vector2f topleft)
+{
+  dimension_ = dimension;
+  std::size_t count = std::size_t(std::max(dimension.x, 0)) * std::max(dimension.y, 0);
+  vertices_.assign(count * 4, sf::Vertex{});
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    Vector2f corner{topleft.x + tile_size.x * float(i % dimension.y),
+                    topleft.y + tile_size.y * float(i / dimension.y)};
+    sf::Vertex *quad = &vertices_[i * 4];
+    quad[0].position = corner;
+    quad[1].position = corner + Vector2f{0, tile_size.y};
+    quad[2].position = corner + tile_size;
+    quad[3].position = corner + Vector2f{tile_size.x, 0};
+  }
+  buffer_.reset();
+  dirty_begin_ = 0;
+  dirty_end_ = count;
+}
+
+inline void Tile_layer::set_texture(const sf::Texture *texture)
+{
+  texture_ = texture;
+}
+
+// Shows 'texture_rect' of the layer's texture on tile 'index'
+inline void Tile_layer::set_tile(const int index, const sf::IntRect &texture_rect)
+{
+  assert(index >= 0 && std::size_t(index) < tile_count());
+  float left = float(texture_rect.left);
+  float top = float(texture_rect.top);
+  float right = left + float(texture_rect.width);
+  float bottom = top + float(texture_rect.height);
+  sf::Vertex *quad = &vertices_[std::size_t(index) * 4];
+  quad[0].texCoords = Vector2f{left, top};
+  quad[1].texCoords = Vector2f{left, bottom};
+  quad[2].texCoords = Vector2f{right, bottom};
+  quad[3].texCoords = Vector2f{right, top};
+  mark_dirty(std::size_t(index));
+}
+
+// Tints tile 'index', e.g. to highlight it
+inline void Tile_layer::set_color(const int index, const Color &color)
+{
+  assert(index >= 0 && std::size_t(index) < tile_count());
+  for (int v = 0; v < 4; ++v)
+    vertices_[std::size_t(index) * 4 + v].color = color;
+  mark_dirty(std::size_t(index));
+}
+
+inline std::size_t Tile_layer::tile_count() const
+{
+  return vertices_.size() / 4;
+}
+
+// Tiles in the span that the next draw uploads
+inline std::size_t Tile_layer::dirty_tiles() const
+{
+  return dirty_end_ - dirty_begin_;
+}
+
+inline const sf::Vertex *Tile_layer::tile_vertices(const int index) const
 {
-  return state == AnimationState::Playing;
+  return &vertices_[std::size_t(index) * 4];
 }
 
-inline std::string AnimatedSprite::getPlayingAnimation() const
+inline void Tile_layer::mark_dirty(const std::size_t index)
 {
-  if (isPlayingAnimation())
+  if (dirty_begin_ == dirty_end_)
   {
-    return activeAnimation;
+    dirty_begin_ = index;
+    dirty_end_ = index + 1;
   }
   else
   {
-    return "";
+    dirty_begin_ = std::min(dirty_begin_, index);
+    dirty_end_ = std::max(dirty_end_, index + 1);
   }
 }
 
-inline bool AnimatedSprite::isPlayingAnimation(const std::string& id) const
-{
-  return state == AnimationState::Playing && activeAnimation == id;
-}
-
-inline std::string AnimatedSprite::getActiveAnimation() const
+// Draws from the vertex buffer, or from the vertex array where OpenGL has
+// no vertex buffers
+inline void Tile_layer::draw(sf::RenderTarget &target, sf::RenderStates states) const
 {
-  return activeAnimation;
+  if (vertices_.empty())
+    return;
+  states.texture = texture_;
+  if (!buffer_ && sf::VertexBuffer::isAvailable())
+  {
+    buffer_.reset(new sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static));
+    if (!buffer_->create(vertices_.size()))
+      buffer_.reset();
+    dirty_begin_ = 0;
+    dirty_end_ = tile_count();
+  }
+  if (buffer_)
+  {
+    if (dirty_begin_ != dirty_end_)
+      buffer_->update(&vertices_[dirty_begin_ * 4], (dirty_end_ - dirty_begin_) * 4,
+                      unsigned(dirty_begin_ * 4));
+    target.draw(*buffer_, states);
+  }
+  else
+    target.draw(vertices_.data(), vertices_.size(), sf::Quads, states);
+  dirty_begin_ = dirty_end_ = 0;
 }
 
 const std::string DEFAULT_FONT = "UbuntuMono-R.ttf";
@@ -661,8 +2168,7 @@ inline Text::Text(const std::string &text_string,
            const Identifier font)
 {
   setString(text_string);
-  font_holder.load(font, font);
-  setFont(font_holder.get(font));
+  setFont(font_holder.get(font_holder.load(font, font)));
   setCharacterSize(font_size);
   setFillColor(DEFAULT_TEXT_COLOR);
 }
@@ -707,8 +2213,7 @@ public:
 
 inline Sound::Sound(const std::string &filename) : sf::Sound()
 {
-  sound_buffer_holder.load(filename, filename);
-  setBuffer(sound_buffer_holder.get(filename));
+  setBuffer(sound_buffer_holder.get(sound_buffer_holder.load(filename, filename)));
 }
 
 inline Sound create_sound(const std::string &filename)
@@ -812,97 +2317,245 @@ inline bool is_inside_rectangle(const Point point, const Rectangle &rectangle)
 
 namespace Collision
 {
-class BitmaskManager
+// Alpha mask of a texture, one bit per pixel: set where the pixel's alpha is
+// over the mask's threshold. Bit x of a row is bit x % 64 of word x / 64.
+struct Bitmask
 {
- public:
-  ~BitmaskManager()
+  unsigned int Width = 0;
+  unsigned int Height = 0;
+  unsigned int WordsPerRow = 0; // one more than needed, so Word() can read past the end
+  std::vector<std::uint64_t> Bits;
+
+  bool Get(unsigned int x, unsigned int y) const
   {
-    std::map<const sf::Texture *, sf::Uint8 *>::const_iterator end = Bitmasks.end();
-    for (std::map<const sf::Texture *, sf::Uint8 *>::const_iterator iter = Bitmasks.begin(); iter != end; iter++)
-      delete[] iter->second;
+    return (Bits[y * WordsPerRow + x / 64] >> (x % 64)) & 1;
   }
 
-  sf::Uint8 GetPixel(const sf::Uint8 *mask, const sf::Texture *tex, unsigned int x, unsigned int y)
+  // The 64 bits of row 'y' from bit 'x' on
+  std::uint64_t Word(unsigned int x, unsigned int y) const
   {
-    if (x > tex->getSize().x || y > tex->getSize().y)
-      return 0;
-
-    return mask[x + y * tex->getSize().x];
+    const std::uint64_t *row = &Bits[y * WordsPerRow + x / 64];
+    unsigned int shift = x % 64;
+    return shift ? (row[0] >> shift) | (row[1] << (64 - shift)) : row[0];
   }
+};
 
-  sf::Uint8 *GetMask(const sf::Texture *tex)
+inline Bitmask MakeBitmask(const sf::Image &img, sf::Uint8 AlphaLimit)
+{
+  Bitmask mask;
+  mask.Width = img.getSize().x;
+  mask.Height = img.getSize().y;
+  mask.WordsPerRow = (mask.Width + 63) / 64 + 1;
+  mask.Bits.assign(std::size_t(mask.WordsPerRow) * mask.Height, 0);
+  const sf::Uint8 *pixels = img.getPixelsPtr();
+  for (unsigned int y = 0; y < mask.Height; y++)
   {
-    sf::Uint8 *mask;
-    std::map<const sf::Texture *, sf::Uint8 *>::iterator pair = Bitmasks.find(tex);
-    if (pair == Bitmasks.end())
+    for (unsigned int x = 0; x < mask.Width; x++)
     {
-      sf::Image img = tex->copyToImage();
-      mask = CreateMask(tex, img);
+      if (pixels[(std::size_t(y) * mask.Width + x) * 4 + 3] > AlphaLimit)
+        mask.Bits[y * mask.WordsPerRow + x / 64] |= std::uint64_t(1) << (x % 64);
     }
-    else
-      mask = pair->second;
-
-    return mask;
   }
+  return mask;
+}
 
-  sf::Uint8 *CreateMask(const sf::Texture *tex, const sf::Image &img)
+// Masks of textures, made on first use for each alpha threshold
+class BitmaskManager
+{
+ public:
+  const Bitmask &GetMask(const sf::Texture *tex, sf::Uint8 AlphaLimit = 0)
   {
-    sf::Uint8 *mask = new sf::Uint8[tex->getSize().y * tex->getSize().x];
-
-    for (unsigned int y = 0; y < tex->getSize().y; y++)
-    {
-      for (unsigned int x = 0; x < tex->getSize().x; x++)
-        mask[x + y * tex->getSize().x] = img.getPixel(x, y).a;
-    }
-
-    Bitmasks.insert(std::pair<const sf::Texture *, sf::Uint8 *>(tex, mask));
+    auto pair = Bitmasks.find(std::make_pair(tex, AlphaLimit));
+    if (pair != Bitmasks.end())
+      return pair->second;
+    return CreateMask(tex, tex->copyToImage(), AlphaLimit);
+  }
 
+  const Bitmask &CreateMask(const sf::Texture *tex, const sf::Image &img, sf::Uint8 AlphaLimit = 0)
+  {
+    Bitmask &mask = Bitmasks[std::make_pair(tex, AlphaLimit)];
+    mask = MakeBitmask(img, AlphaLimit);
     return mask;
   }
 
  private:
-  std::map<const sf::Texture *, sf::Uint8 *> Bitmasks;
+  std::map<std::pair<const sf::Texture *, sf::Uint8>, Bitmask> Bitmasks;
 };
 
 static BitmaskManager Bitmasks;
 
-inline bool PixelPerfectTest(const sf::Sprite &Object1, const sf::Sprite &Object2, sf::Uint8 AlphaLimit)
+namespace Detail
 {
-  sf::FloatRect Intersection;
-  if (Object1.getGlobalBounds().intersects(Object2.getGlobalBounds(), Intersection))
-  {
-    sf::IntRect O1SubRect = Object1.getTextureRect();
-    sf::IntRect O2SubRect = Object2.getTextureRect();
+// True for a transform that only moves by whole pixels
+inline bool IsPixelTranslation(const sf::Transform &Transform)
+{
+  const float *m = Transform.getMatrix();
+  return m[0] == 1.f && m[1] == 0.f && m[4] == 0.f && m[5] == 1.f &&
+         m[12] == std::floor(m[12]) && m[13] == std::floor(m[13]);
+}
 
-    sf::Uint8 *mask1 = Bitmasks.GetMask(Object1.getTexture());
-    sf::Uint8 *mask2 = Bitmasks.GetMask(Object2.getTexture());
+inline sf::FloatRect WorldBounds(const sf::IntRect &SubRect, const sf::Transform &Transform)
+{
+  sf::Vector2f corners[4] = {Transform.transformPoint(0.f, 0.f),
+                             Transform.transformPoint(float(SubRect.width), 0.f),
+                             Transform.transformPoint(float(SubRect.width), float(SubRect.height)),
+                             Transform.transformPoint(0.f, float(SubRect.height))};
+  float left = corners[0].x, top = corners[0].y, right = left, bottom = top;
+  for (const sf::Vector2f &c : corners)
+  {
+    left = std::min(left, c.x);
+    top = std::min(top, c.y);
+    right = std::max(right, c.x);
+    bottom = std::max(bottom, c.y);
+  }
+  return sf::FloatRect(left, top, right - left, bottom - top);
+}
 
-    // Loop through our pixels
-    for (int i = Intersection.left; i < Intersection.left + Intersection.width; i++)
+inline bool AlignedOverlap(const Bitmask &Mask1, const sf::IntRect &SubRect1, const sf::Vector2i Offset1,
+                           const Bitmask &Mask2, const sf::IntRect &SubRect2, const sf::Vector2i Offset2)
+{
+  int left = std::max(Offset1.x, Offset2.x);
+  int top = std::max(Offset1.y, Offset2.y);
+  int right = std::min(Offset1.x + SubRect1.width, Offset2.x + SubRect2.width);
+  int bottom = std::min(Offset1.y + SubRect1.height, Offset2.y + SubRect2.height);
+  for (int y = top; y < bottom; y++)
+  {
+    unsigned int y1 = unsigned(y - Offset1.y + SubRect1.top);
+    unsigned int y2 = unsigned(y - Offset2.y + SubRect2.top);
+    for (int x = left; x < right; x += 64)
     {
-      for (int j = Intersection.top; j < Intersection.top + Intersection.height; j++)
-      {
-
-        sf::Vector2f o1v = Object1.getInverseTransform().transformPoint(i, j);
-        sf::Vector2f o2v = Object2.getInverseTransform().transformPoint(i, j);
+      std::uint64_t span = right - x >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << (right - x)) - 1;
+      if (Mask1.Word(unsigned(x - Offset1.x + SubRect1.left), y1) &
+          Mask2.Word(unsigned(x - Offset2.x + SubRect2.left), y2) & span)
+        return true;
+    }
+  }
+  return false;
+}
 
-        // Make sure pixels fall within the sprite's subrect
-        if (o1v.x > 0 && o1v.y > 0 && o2v.x > 0 && o2v.y > 0 &&
-            o1v.x < O1SubRect.width && o1v.y < O1SubRect.height &&
-            o2v.x < O2SubRect.width && o2v.y < O2SubRect.height)
-        {
+// Whether the point (x, y) of a mask's sub-rect is set; (x, y) must be inside
+inline bool Covered(const Bitmask &Mask, const sf::IntRect &SubRect, float x, float y)
+{
+  return Mask.Get(unsigned(int(x)) + SubRect.left, unsigned(int(y)) + SubRect.top);
+}
 
-          if (Bitmasks.GetPixel(mask1, Object1.getTexture(), (int)(o1v.x) + O1SubRect.left, (int)(o1v.y) + O1SubRect.top) > AlphaLimit &&
-              Bitmasks.GetPixel(mask2, Object2.getTexture(), (int)(o2v.x) + O2SubRect.left, (int)(o2v.y) + O2SubRect.top) > AlphaLimit)
-            return true;
-        }
+inline bool TransformedOverlap(const Bitmask &Mask1, const sf::IntRect &SubRect1, const sf::Transform &Inverse1,
+                               const Bitmask &Mask2, const sf::IntRect &SubRect2, const sf::Transform &Inverse2,
+                               const sf::FloatRect &Intersection)
+{
+  const float *m1 = Inverse1.getMatrix();
+  const float *m2 = Inverse2.getMatrix();
+  const float w1 = float(SubRect1.width), h1 = float(SubRect1.height);
+  const float w2 = float(SubRect2.width), h2 = float(SubRect2.height);
+  const int left = int(std::floor(Intersection.left));
+  const int top = int(std::floor(Intersection.top));
+  const float right = Intersection.left + Intersection.width;
+  const float bottom = Intersection.top + Intersection.height;
+  for (int j = top; j < bottom; j++)
+  {
+    const float fj = float(j);
+    int i = left;
+#ifdef BASIX_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lanes = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    // Row terms of x = m0 * i + m4 * j + m12, as in sf::Transform::transformPoint
+    const __m128 x1j = _mm_set1_ps(m1[4] * fj), y1j = _mm_set1_ps(m1[5] * fj);
+    const __m128 x2j = _mm_set1_ps(m2[4] * fj), y2j = _mm_set1_ps(m2[5] * fj);
+    for (; i + 4 <= right; i += 4)
+    {
+      __m128 fi = _mm_add_ps(_mm_set1_ps(float(i)), lanes);
+      __m128 x1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m1[0]), fi), x1j), _mm_set1_ps(m1[12]));
+      __m128 y1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m1[1]), fi), y1j), _mm_set1_ps(m1[13]));
+      __m128 x2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m2[0]), fi), x2j), _mm_set1_ps(m2[12]));
+      __m128 y2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m2[1]), fi), y2j), _mm_set1_ps(m2[13]));
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x1, zero), _mm_cmplt_ps(x1, _mm_set1_ps(w1))),
+                                 _mm_and_ps(_mm_cmpge_ps(y1, zero), _mm_cmplt_ps(y1, _mm_set1_ps(h1))));
+      inside = _mm_and_ps(inside, _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x2, zero), _mm_cmplt_ps(x2, _mm_set1_ps(w2))),
+                                             _mm_and_ps(_mm_cmpge_ps(y2, zero), _mm_cmplt_ps(y2, _mm_set1_ps(h2)))));
+      int lanes_inside = _mm_movemask_ps(inside);
+      if (!lanes_inside)
+        continue;
+      alignas(16) float px1[4], py1[4], px2[4], py2[4];
+      _mm_store_ps(px1, x1);
+      _mm_store_ps(py1, y1);
+      _mm_store_ps(px2, x2);
+      _mm_store_ps(py2, y2);
+      for (int k = 0; k < 4; k++)
+      {
+        if ((lanes_inside >> k) & 1 &&
+            Covered(Mask1, SubRect1, px1[k], py1[k]) && Covered(Mask2, SubRect2, px2[k], py2[k]))
+          return true;
       }
     }
+#endif
+    for (; i < right; i++)
+    {
+      const float fi = float(i);
+      float x1 = m1[0] * fi + m1[4] * fj + m1[12];
+      float y1 = m1[1] * fi + m1[5] * fj + m1[13];
+      float x2 = m2[0] * fi + m2[4] * fj + m2[12];
+      float y2 = m2[1] * fi + m2[5] * fj + m2[13];
+      if (x1 >= 0 && x1 < w1 && y1 >= 0 && y1 < h1 && x2 >= 0 && x2 < w2 && y2 >= 0 && y2 < h2 &&
+          Covered(Mask1, SubRect1, x1, y1) && Covered(Mask2, SubRect2, x2, y2))
+        return true;
+    }
   }
   return false;
 }
 
-inline bool CreateTextureAndBitmask(sf::Texture &LoadInto, const std::string &Filename)
+// Cuts 'SubRect' down to the part inside the mask, moving 'Transform' so the
+// remaining pixels stay where they were. A texture rect may reach past its
+// texture (repeated textures); the pixels outside count as unset. False if
+// nothing is left.
+inline bool ClipToMask(const Bitmask &Mask, sf::IntRect &SubRect, sf::Transform &Transform)
+{
+  sf::IntRect Clipped;
+  if (!SubRect.intersects(sf::IntRect(0, 0, int(Mask.Width), int(Mask.Height)), Clipped))
+    return false;
+  Transform.translate(float(Clipped.left - SubRect.left), float(Clipped.top - SubRect.top));
+  SubRect = Clipped;
+  return true;
+}
+} // namespace Detail
+
+// True if some world pixel (at whole coordinates) is set in both masks.
+// Each mask is seen through 'SubRect' and placed by 'Transform', like a
+// sprite's texture rect and transform; a world pixel (x, y) samples the mask
+// at the inverse of Transform applied to (x, y), truncated.
+//
+// Unrotated, unscaled masks at whole-pixel positions are tested 64 pixels at
+// a time by ANDing shifted mask words. Other transforms map four pixels at a
+// time through the inverse transforms with SSE2, where available. Parts of a
+// sub-rect outside its mask are unset.
+inline bool MasksOverlap(const Bitmask &Mask1, sf::IntRect SubRect1, sf::Transform Transform1,
+                         const Bitmask &Mask2, sf::IntRect SubRect2, sf::Transform Transform2)
+{
+  if (!Detail::ClipToMask(Mask1, SubRect1, Transform1) || !Detail::ClipToMask(Mask2, SubRect2, Transform2))
+    return false;
+  sf::FloatRect Intersection;
+  if (!Detail::WorldBounds(SubRect1, Transform1).intersects(Detail::WorldBounds(SubRect2, Transform2), Intersection))
+    return false;
+  if (Detail::IsPixelTranslation(Transform1) && Detail::IsPixelTranslation(Transform2))
+  {
+    const float *m1 = Transform1.getMatrix();
+    const float *m2 = Transform2.getMatrix();
+    return Detail::AlignedOverlap(Mask1, SubRect1, sf::Vector2i(int(m1[12]), int(m1[13])),
+                                  Mask2, SubRect2, sf::Vector2i(int(m2[12]), int(m2[13])));
+  }
+  return Detail::TransformedOverlap(Mask1, SubRect1, Transform1.getInverse(),
+                                    Mask2, SubRect2, Transform2.getInverse(), Intersection);
+}
+
+// True if opaque pixels (alpha over 'AlphaLimit') of the two sprites overlap
+inline bool PixelPerfectTest(const sf::Sprite &Object1, const sf::Sprite &Object2, sf::Uint8 AlphaLimit)
+{
+  if (!Object1.getGlobalBounds().intersects(Object2.getGlobalBounds()))
+    return false;
+  return MasksOverlap(Bitmasks.GetMask(Object1.getTexture(), AlphaLimit), Object1.getTextureRect(), Object1.getTransform(),
+                      Bitmasks.GetMask(Object2.getTexture(), AlphaLimit), Object2.getTextureRect(), Object2.getTransform());
+}
+
+inline bool CreateTextureAndBitmask(sf::Texture &LoadInto, const std::string &Filename, sf::Uint8 AlphaLimit = 0)
 {
   sf::Image img;
   if (!img.loadFromFile(Filename))
@@ -910,7 +2563,7 @@ inline bool CreateTextureAndBitmask(sf::Texture &LoadInto, const std::string &Fi
   if (!LoadInto.loadFromImage(img))
     return false;
 
-  Bitmasks.CreateMask(&LoadInto, img);
+  Bitmasks.CreateMask(&LoadInto, img, AlphaLimit);
   return true;
 }
 
@@ -1001,6 +2654,484 @@ inline bool BoundingBoxTest(const sf::Sprite &Object1, const sf::Sprite &Object2
   }
   return true;
 }
+
+// Oriented bounding boxes of many sprites, for testing one box against all
+// the others at once
+//
+// Each box is computed from its sprite's transform and texture rect and kept
+// until Refresh() sees either change. Corners, edge axes and each box's
+// extent along its own axes are stored as one array per field, so a query
+// projects onto four boxes per step with SSE2 where available. Overlap means
+// the same as for BoundingBoxTest:
+//
+//     Collision::OrientedBoxSet boxes;
+//     auto hero = boxes.Add(hero_sprite);
+//     for (auto &enemy : enemies)
+//       boxes.Add(enemy);
+//     ...
+//     boxes.Refresh();
+//     hits.clear();
+//     boxes.Query(hero, hits);
+class OrientedBoxSet
+{
+ public:
+  using Box = std::uint32_t;
+
+  Box Add(const sf::Sprite &Object)
+  {
+    Box box;
+    if (FreeBoxes.empty())
+    {
+      box = Box(Sources.size());
+      Sources.push_back(nullptr);
+      Keys.emplace_back();
+      if (Sources.size() > Lanes())
+        Grow();
+    }
+    else
+    {
+      box = FreeBoxes.back();
+      FreeBoxes.pop_back();
+    }
+    Sources[box] = &Object;
+    Store(box, Object);
+    return box;
+  }
+
+  void Remove(Box box)
+  {
+    Sources[box] = nullptr;
+    Clear(box);
+    FreeBoxes.push_back(box);
+  }
+
+  const sf::Sprite *Sprite(Box box) const { return Sources[box]; }
+
+  // Recomputes the box if its sprite moved, turned, scaled or changed its
+  // texture rect since it was last computed; true if it did
+  bool Refresh(Box box)
+  {
+    if (!Sources[box] || KeyOf(*Sources[box]) == Keys[box])
+      return false;
+    Store(box, *Sources[box]);
+    return true;
+  }
+
+  void Refresh()
+  {
+    for (Box box = 0; box < Sources.size(); box++)
+      Refresh(box);
+  }
+
+  bool Test(Box a, Box b) const
+  {
+    sf::Vector2f Points[4];
+    CornersOf(a, Points);
+    Axes query(Points);
+    return Overlaps(query, Points, b);
+  }
+
+  // Appends to 'found' every other box that overlaps 'box'
+  void Query(Box box, std::vector<Box> &found) const
+  {
+    sf::Vector2f Points[4];
+    CornersOf(box, Points);
+    QueryPoints(Points, box, found);
+  }
+
+  // Appends to 'found' every box that overlaps the sprite, which need not be
+  // in the set
+  void Query(const sf::Sprite &Object, std::vector<Box> &found) const
+  {
+    OrientedBoundingBox OBB(Object);
+    QueryPoints(OBB.Points, Box(-1), found);
+  }
+
+ private:
+  // A box's two edge axes and its extent along each
+  struct Axes
+  {
+    explicit Axes(const sf::Vector2f (&Points)[4])
+    {
+      for (int k = 0; k < 2; k++)
+      {
+        sf::Vector2f Edge = Points[k == 0 ? 1 : 3] - Points[0];
+        X[k] = Edge.x;
+        Y[k] = Edge.y;
+        Project(Points, X[k], Y[k], Min[k], Max[k]);
+      }
+    }
+
+    float X[2], Y[2], Min[2], Max[2];
+  };
+
+  // Matrix terms used by a 2D transform, then the texture rect size
+  using Key = std::array<float, 8>;
+
+  static Key KeyOf(const sf::Sprite &Object)
+  {
+    const float *m = Object.getTransform().getMatrix();
+    sf::IntRect rect = Object.getTextureRect();
+    return Key{{m[0], m[1], m[4], m[5], m[12], m[13], float(rect.width), float(rect.height)}};
+  }
+
+  static void Project(const sf::Vector2f (&Points)[4], float AxisX, float AxisY, float &Min, float &Max)
+  {
+    Min = Max = Points[0].x * AxisX + Points[0].y * AxisY;
+    for (int i = 1; i < 4; i++)
+    {
+      float Projection = Points[i].x * AxisX + Points[i].y * AxisY;
+      Min = std::min(Min, Projection);
+      Max = std::max(Max, Projection);
+    }
+  }
+
+  // Room in the arrays, a whole number of SSE2 vectors
+  std::size_t Lanes() const { return Min[0].size(); }
+
+  void Grow()
+  {
+    std::size_t lanes = std::max<std::size_t>(4, Lanes() * 2);
+    for (int i = 0; i < 4; i++)
+    {
+      X[i].resize(lanes, 0.f);
+      Y[i].resize(lanes, 0.f);
+    }
+    for (int k = 0; k < 2; k++)
+    {
+      AxisX[k].resize(lanes, 0.f);
+      AxisY[k].resize(lanes, 0.f);
+      // Unused lanes get an empty extent so they never overlap
+      Min[k].resize(lanes, INFINITY);
+      Max[k].resize(lanes, -INFINITY);
+    }
+  }
+
+  void Store(Box box, const sf::Sprite &Object)
+  {
+    OrientedBoundingBox OBB(Object);
+    Axes axes(OBB.Points);
+    for (int i = 0; i < 4; i++)
+    {
+      X[i][box] = OBB.Points[i].x;
+      Y[i][box] = OBB.Points[i].y;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+      AxisX[k][box] = axes.X[k];
+      AxisY[k][box] = axes.Y[k];
+      Min[k][box] = axes.Min[k];
+      Max[k][box] = axes.Max[k];
+    }
+    Keys[box] = KeyOf(Object);
+  }
+
+  void Clear(Box box)
+  {
+    for (int i = 0; i < 4; i++)
+      X[i][box] = Y[i][box] = 0.f;
+    for (int k = 0; k < 2; k++)
+    {
+      AxisX[k][box] = AxisY[k][box] = 0.f;
+      Min[k][box] = INFINITY;
+      Max[k][box] = -INFINITY;
+    }
+    Keys[box] = Key();
+  }
+
+  void CornersOf(Box box, sf::Vector2f (&Points)[4]) const
+  {
+    for (int i = 0; i < 4; i++)
+      Points[i] = sf::Vector2f(X[i][box], Y[i][box]);
+  }
+
+  // Separating axis test of the query box against one stored box
+  bool Overlaps(const Axes &query, const sf::Vector2f (&Points)[4], std::size_t box) const
+  {
+    for (int k = 0; k < 2; k++)
+    {
+      float Lo = X[0][box] * query.X[k] + Y[0][box] * query.Y[k], Hi = Lo;
+      for (int i = 1; i < 4; i++)
+      {
+        float Projection = X[i][box] * query.X[k] + Y[i][box] * query.Y[k];
+        Lo = std::min(Lo, Projection);
+        Hi = std::max(Hi, Projection);
+      }
+      if (!(Lo <= query.Max[k] && Hi >= query.Min[k]))
+        return false;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+      float Lo, Hi;
+      Project(Points, AxisX[k][box], AxisY[k][box], Lo, Hi);
+      if (!(Lo <= Max[k][box] && Hi >= Min[k][box]))
+        return false;
+    }
+    return true;
+  }
+
+  void QueryPoints(const sf::Vector2f (&Points)[4], Box skip, std::vector<Box> &found) const
+  {
+    Axes query(Points);
+    std::size_t box = 0;
+#ifdef BASIX_SSE2
+    for (; box < Lanes(); box += 4)
+    {
+      __m128 hit = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      // The stored boxes onto the query box's axes ...
+      for (int k = 0; k < 2; k++)
+      {
+        const __m128 ax = _mm_set1_ps(query.X[k]), ay = _mm_set1_ps(query.Y[k]);
+        __m128 lo = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&X[0][box]), ax), _mm_mul_ps(_mm_loadu_ps(&Y[0][box]), ay));
+        __m128 hi = lo;
+        for (int i = 1; i < 4; i++)
+        {
+          __m128 p = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&X[i][box]), ax), _mm_mul_ps(_mm_loadu_ps(&Y[i][box]), ay));
+          lo = _mm_min_ps(lo, p);
+          hi = _mm_max_ps(hi, p);
+        }
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(lo, _mm_set1_ps(query.Max[k])),
+                                         _mm_cmpge_ps(hi, _mm_set1_ps(query.Min[k]))));
+      }
+      // ... and the query box onto each stored box's axes
+      for (int k = 0; k < 2; k++)
+      {
+        const __m128 ax = _mm_loadu_ps(&AxisX[k][box]), ay = _mm_loadu_ps(&AxisY[k][box]);
+        __m128 lo = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Points[0].x), ax), _mm_mul_ps(_mm_set1_ps(Points[0].y), ay));
+        __m128 hi = lo;
+        for (int i = 1; i < 4; i++)
+        {
+          __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Points[i].x), ax), _mm_mul_ps(_mm_set1_ps(Points[i].y), ay));
+          lo = _mm_min_ps(lo, p);
+          hi = _mm_max_ps(hi, p);
+        }
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(lo, _mm_loadu_ps(&Max[k][box])),
+                                         _mm_cmpge_ps(hi, _mm_loadu_ps(&Min[k][box]))));
+      }
+      int hits = _mm_movemask_ps(hit);
+      for (int j = 0; hits; j++, hits >>= 1)
+      {
+        if (hits & 1 && box + j != skip)
+          found.push_back(Box(box + j));
+      }
+    }
+#endif
+    for (; box < Sources.size(); box++)
+    {
+      if (box != skip && Overlaps(query, Points, box))
+        found.push_back(Box(box));
+    }
+  }
+
+  std::vector<const sf::Sprite *> Sources; // null for removed boxes
+  std::vector<Key> Keys;
+  std::vector<Box> FreeBoxes;
+  std::vector<float> X[4], Y[4];         // corners
+  std::vector<float> AxisX[2], AxisY[2]; // edges from corner 0
+  std::vector<float> Min[2], Max[2];     // own extent along each edge
+};
+
+// Broad phase: finds the pairs of objects whose bounds overlap without
+// testing every pair
+//
+// Space is divided into square cells and each object is listed in the cells
+// its bounds touch, so only objects sharing a cell are compared. Objects
+// are added once and moved as they move; moving within the same cells only
+// updates the stored bounds. The pairs found are candidates for the exact
+// tests above:
+//
+//     Collision::SpatialHash grid(64);
+//     auto hero = grid.Add(hero_sprite);
+//     ...
+//     grid.Update(hero, hero_sprite);
+//     grid.ForEachPair([&](auto a, auto b) {
+//       if (PixelPerfectTest(*grid.Sprite(a), *grid.Sprite(b), 0)) ...
+//     });
+//
+// Cells a little larger than a typical object work best.
+class SpatialHash
+{
+ public:
+  using Proxy = std::uint32_t;
+
+  explicit SpatialHash(float CellSize = 64.f) : CellSize(CellSize) {}
+
+  Proxy Add(const sf::FloatRect &Bounds, const void *Object = nullptr)
+  {
+    Proxy proxy;
+    if (FreeProxies.empty())
+    {
+      proxy = Proxy(Entries.size());
+      Entries.emplace_back();
+    }
+    else
+    {
+      proxy = FreeProxies.back();
+      FreeProxies.pop_back();
+    }
+    Entry &entry = Entries[proxy];
+    entry.Bounds = Bounds;
+    entry.Cells = CellRange(Bounds);
+    entry.Object = Object;
+    entry.Alive = true;
+    Link(proxy, entry.Cells);
+    return proxy;
+  }
+
+  Proxy Add(const sf::Sprite &Object)
+  {
+    return Add(Object.getGlobalBounds(), &Object);
+  }
+
+  void Move(Proxy proxy, const sf::FloatRect &Bounds)
+  {
+    Entry &entry = Entries[proxy];
+    sf::IntRect cells = CellRange(Bounds);
+    entry.Bounds = Bounds;
+    if (cells != entry.Cells)
+    {
+      Unlink(proxy, entry.Cells);
+      entry.Cells = cells;
+      Link(proxy, cells);
+    }
+  }
+
+  void Update(Proxy proxy, const sf::Sprite &Object)
+  {
+    Move(proxy, Object.getGlobalBounds());
+  }
+
+  void Remove(Proxy proxy)
+  {
+    Entry &entry = Entries[proxy];
+    Unlink(proxy, entry.Cells);
+    entry.Alive = false;
+    entry.Object = nullptr;
+    FreeProxies.push_back(proxy);
+  }
+
+  const sf::FloatRect &Bounds(Proxy proxy) const { return Entries[proxy].Bounds; }
+  const void *Object(Proxy proxy) const { return Entries[proxy].Object; }
+  const sf::Sprite *Sprite(Proxy proxy) const { return static_cast<const sf::Sprite *>(Entries[proxy].Object); }
+
+  // Calls f(a, b) once for every pair of objects whose bounds intersect
+  template <typename F>
+  void ForEachPair(F f) const
+  {
+    for (const auto &cell : Cells)
+    {
+      const std::vector<Proxy> &list = cell.second;
+      const sf::Vector2i here = Unpack(cell.first);
+      for (std::size_t i = 0; i < list.size(); i++)
+      {
+        const sf::FloatRect &a = Entries[list[i]].Bounds;
+        for (std::size_t j = i + 1; j < list.size(); j++)
+        {
+          // A pair shares every cell its overlap touches; only the cell
+          // holding the overlap's top left corner reports it
+          sf::FloatRect overlap;
+          if (a.intersects(Entries[list[j]].Bounds, overlap) &&
+              CellOf(overlap.left, overlap.top) == here)
+            f(std::min(list[i], list[j]), std::max(list[i], list[j]));
+        }
+      }
+    }
+  }
+
+  std::vector<std::pair<Proxy, Proxy>> Pairs() const
+  {
+    std::vector<std::pair<Proxy, Proxy>> pairs;
+    ForEachPair([&pairs](Proxy a, Proxy b) { pairs.emplace_back(a, b); });
+    return pairs;
+  }
+
+  // Appends to 'found' the objects whose bounds intersect 'Area', once each
+  void Query(const sf::FloatRect &Area, std::vector<Proxy> &found) const
+  {
+    ++QueryStamp;
+    sf::IntRect cells = CellRange(Area);
+    for (int y = cells.top; y < cells.top + cells.height; y++)
+    {
+      for (int x = cells.left; x < cells.left + cells.width; x++)
+      {
+        auto cell = Cells.find(Pack(x, y));
+        if (cell == Cells.end())
+          continue;
+        for (Proxy proxy : cell->second)
+        {
+          const Entry &entry = Entries[proxy];
+          if (entry.Stamp != QueryStamp && entry.Bounds.intersects(Area))
+          {
+            entry.Stamp = QueryStamp;
+            found.push_back(proxy);
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  struct Entry
+  {
+    sf::FloatRect Bounds;
+    sf::IntRect Cells; // first cell and number of cells across and down
+    const void *Object = nullptr;
+    bool Alive = false;
+    mutable std::uint32_t Stamp = 0; // last Query() that found it
+  };
+
+  static std::uint64_t Pack(int x, int y)
+  {
+    return (std::uint64_t(std::uint32_t(x)) << 32) | std::uint32_t(y);
+  }
+
+  static sf::Vector2i Unpack(std::uint64_t key)
+  {
+    return sf::Vector2i(int(std::uint32_t(key >> 32)), int(std::uint32_t(key)));
+  }
+
+  sf::Vector2i CellOf(float x, float y) const
+  {
+    return sf::Vector2i(int(std::floor(x / CellSize)), int(std::floor(y / CellSize)));
+  }
+
+  sf::IntRect CellRange(const sf::FloatRect &Bounds) const
+  {
+    sf::Vector2i first = CellOf(Bounds.left, Bounds.top);
+    sf::Vector2i last = CellOf(Bounds.left + Bounds.width, Bounds.top + Bounds.height);
+    return sf::IntRect(first.x, first.y, last.x - first.x + 1, last.y - first.y + 1);
+  }
+
+  void Link(Proxy proxy, const sf::IntRect &cells)
+  {
+    for (int y = cells.top; y < cells.top + cells.height; y++)
+      for (int x = cells.left; x < cells.left + cells.width; x++)
+        Cells[Pack(x, y)].push_back(proxy);
+  }
+
+  void Unlink(Proxy proxy, const sf::IntRect &cells)
+  {
+    for (int y = cells.top; y < cells.top + cells.height; y++)
+    {
+      for (int x = cells.left; x < cells.left + cells.width; x++)
+      {
+        auto cell = Cells.find(Pack(x, y));
+        std::vector<Proxy> &list = cell->second;
+        auto found = std::find(list.begin(), list.end(), proxy);
+        *found = list.back();
+        list.pop_back();
+        if (list.empty())
+          Cells.erase(cell);
+      }
+    }
+  }
+
+  float CellSize;
+  std::vector<Entry> Entries;
+  std::vector<Proxy> FreeProxies;
+  std::unordered_map<std::uint64_t, std::vector<Proxy>> Cells;
+  mutable std::uint32_t QueryStamp = 0;
+};
 } // namespace Collision
 
 using namespace basix;
@@ -2,13 +2,7 @@
 #define cell_hpp
 
 #include "basix.hpp"
-
-enum class CellType
-{
-    Wall,
-    Corridor,
-    Exit
-};
+#include "maze_grid.hpp"
 
 class Cell : public Sprite
 {
@@ -1,10 +1,16 @@
 #ifndef ENGINE3D_H_
 #define ENGINE3D_H_
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 #include "matrix.hpp"
 #include "basix.hpp"
+#include "arena.hpp"
+#include "texture.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 
 namespace e3d {
     const matrix::Matrix4x4 buildRotationMatrix(const double xrot, const double yrot, const double zrot) {
@@ -115,47 +121,482 @@ namespace e3d {
         return matrix::Vector3{transformed[0], transformed[1], transformed[2]};
     }
 
+    // Data interpolated across a triangle besides its position: texture
+    // coordinates and an RGBA color (0 to 1) that modulates the material
+    struct VertexAttributes {
+        float u = 0;
+        float v = 0;
+        float r = 1;
+        float g = 1;
+        float b = 1;
+        float a = 1;
+    };
+
+    inline VertexAttributes lerp(const VertexAttributes& x, const VertexAttributes& y, const float t) {
+        return VertexAttributes{x.u + t * (y.u - x.u), x.v + t * (y.v - x.v),
+                                x.r + t * (y.r - x.r), x.g + t * (y.g - x.g),
+                                x.b + t * (y.b - x.b), x.a + t * (y.a - x.a)};
+    }
+
     class Triangle {
         public:
+            Triangle() = default;
+            // Default normals and attributes: white, untextured
+            Triangle(const matrix::Vector3& a, const matrix::Vector3& b, const matrix::Vector3& c)
+                : a {a}, b {b}, c {c} {}
+
             matrix::Vector3 a;
             matrix::Vector3 b;
             matrix::Vector3 c;
+            // Per corner, in a, b, c order. Normals are in object space and
+            // are kept for lighting; the rasterizer doesn't use them yet.
+            matrix::Vector3 normals[3] {};
+            VertexAttributes attributes[3];
+    };
+
+    // Clips a convex polygon in camera space against the near plane. The camera
+    // looks down -z, so points with z > -near are behind it. 'out' must have
+    // room for n + 1 vertices. Returns the number of vertices written to 'out'.
+    inline int clipNear(const matrix::Vector3* in, const int n, matrix::Vector3* out, const double near) {
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const matrix::Vector3& a = in[i];
+            const matrix::Vector3& b = in[(i + 1) % n];
+            bool aInside = a[2] <= -near;
+            bool bInside = b[2] <= -near;
+            if (aInside) {
+                out[m++] = a;
+            }
+            if (aInside != bInside) {
+                double t = (-near - a[2]) / (b[2] - a[2]);
+                out[m++] = a + t * (b - a);
+            }
+        }
+        return m;
+    }
+
+    // Same, carrying each vertex's attributes along; 'outAttributes' needs
+    // room for n + 1 entries too
+    inline int clipNear(const matrix::Vector3* in, const VertexAttributes* inAttributes, const int n,
+                        matrix::Vector3* out, VertexAttributes* outAttributes, const double near) {
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const matrix::Vector3& a = in[i];
+            const matrix::Vector3& b = in[(i + 1) % n];
+            bool aInside = a[2] <= -near;
+            bool bInside = b[2] <= -near;
+            if (aInside) {
+                outAttributes[m] = inAttributes[i];
+                out[m++] = a;
+            }
+            if (aInside != bInside) {
+                double t = (-near - a[2]) / (b[2] - a[2]);
+                outAttributes[m] = lerp(inAttributes[i], inAttributes[(i + 1) % n], float(t));
+                out[m++] = a + t * (b - a);
+            }
+        }
+        return m;
+    }
+
+    // True if the camera-space polygon lies entirely outside one of the side
+    // planes or the far plane of the view frustum
+    inline bool outsideFrustum(const matrix::Vector3* v, const int n,
+                               const matrix::Matrix4x4& projection, const double far) {
+        bool left = true, right = true, bottom = true, top = true, beyond = true;
+        for (int i = 0; i < n; ++i) {
+            double x = v[i][0] * projection[0][0];
+            double y = v[i][1] * projection[1][1];
+            double w = -v[i][2];
+            left = left && x < -w;
+            right = right && x > w;
+            bottom = bottom && y < -w;
+            top = top && y > w;
+            beyond = beyond && w > far;
+        }
+        return left || right || bottom || top || beyond;
+    }
+
+    // Work done by a Device during the current frame
+    struct RenderStats {
+        std::uint64_t verticesTransformed = 0;
+        std::uint64_t trianglesSubmitted = 0;
+        std::uint64_t trianglesCulled = 0;  // rejected whole: behind the camera or outside the frustum
+        std::uint64_t trianglesClipped = 0; // cut by the near plane
+        std::uint64_t drawCalls = 0;
+        std::uint64_t stateChanges = 0;     // material switches
+        std::uint64_t pixelsWritten = 0;    // as reported by the backend
+        std::uint64_t bytesAllocated = 0;   // transient data taken from the frame arena
+    };
+
+    // Pixels covered by a one pixel wide line from 'a' to 'b'
+    inline std::uint64_t linePixels(const float ax, const float ay, const float bx, const float by) {
+        return std::uint64_t(std::max(std::abs(bx - ax), std::abs(by - ay))) + 1;
+    }
+
+    // Vertex after projection: window coordinates, depth in [-1, 1] and 1/w,
+    // plus the attributes to interpolate (perspective-correctly, with 1/w)
+    struct ScreenVertex {
+        float x;
+        float y;
+        float z;
+        float invW;
+        VertexAttributes attributes;
+    };
+
+    // Surface properties shared by the triangles drawn between two material
+    // changes. The texture, if any, must outlive the frames that use it.
+    struct Material {
+        std::uint8_t r = 255;
+        std::uint8_t g = 255;
+        std::uint8_t b = 255;
+        const Texture* texture = nullptr;
+        Filter filter = Filter::Bilinear;
+    };
+
+    // Where a Device sends its projected geometry. Transient data needed to
+    // draw must come from 'arena', which is reset once per frame.
+    class Backend {
+        public:
+            virtual ~Backend() = default;
+            virtual sf::Vector2u size() const = 0;
+            // Applies to everything drawn until the next call
+            virtual void setMaterial(const Material& material) = 0;
+            // Convex polygon. Returns the number of pixels written.
+            virtual std::uint64_t drawPolygon(const ScreenVertex* vertices, const int count, FrameArena& arena) = 0;
+            // One segment per pair of vertices. Returns the number of pixels written.
+            virtual std::uint64_t drawLines(const ScreenVertex* vertices, const int count, FrameArena& arena) = 0;
+    };
+
+    // Draws polygon outlines into a window through SFML
+    class WindowBackend : public Backend {
+        public:
+            explicit WindowBackend(Window& w) : window {w} {}
+
+            sf::Vector2u size() const override {
+                return window.getSize();
+            }
+
+            void setMaterial(const Material& material) override {
+                color = sf::Color(material.r, material.g, material.b);
+            }
+
+            std::uint64_t drawPolygon(const ScreenVertex* vertices, const int count, FrameArena& arena) override {
+                sf::Vertex* lines = arena.allocate<sf::Vertex>(count + 1);
+                std::uint64_t pixels = 0;
+                for (int i = 0; i < count; ++i) {
+                    lines[i].position = sf::Vector2f(vertices[i].x, vertices[i].y);
+                    lines[i].color = color;
+                    const ScreenVertex& next = vertices[(i + 1) % count];
+                    pixels += linePixels(vertices[i].x, vertices[i].y, next.x, next.y);
+                }
+                lines[count] = lines[0];
+                window.draw(lines, count + 1, sf::LineStrip);
+                return pixels;
+            }
+
+            std::uint64_t drawLines(const ScreenVertex* vertices, const int count, FrameArena& arena) override {
+                sf::Vertex* lines = arena.allocate<sf::Vertex>(count);
+                std::uint64_t pixels = 0;
+                for (int i = 0; i < count; ++i) {
+                    lines[i].position = sf::Vector2f(vertices[i].x, vertices[i].y);
+                    lines[i].color = color;
+                }
+                for (int i = 0; i + 1 < count; i += 2) {
+                    pixels += linePixels(vertices[i].x, vertices[i].y, vertices[i + 1].x, vertices[i + 1].y);
+                }
+                window.draw(lines, count, sf::Lines);
+                return pixels;
+            }
+
+        private:
+            Window& window;
+            sf::Color color = sf::Color::White;
     };
 
     class Device {
         public:
-            Device(Window& w, Camera c) : window {w}, camera {c} {
-                aspectRatio = window.getSize().y/window.getSize().y;
+            Device(Window& w, Camera c) : camera {c}, ownedBackend {new WindowBackend(w)}, backend {ownedBackend.get()} {
+                aspectRatio = float(backend->size().x) / backend->size().y;
+            }
+
+            Device(Backend& b, Camera c) : camera {c}, backend {&b} {
+                aspectRatio = float(backend->size().x) / backend->size().y;
+            }
+
+            // Resets the per-frame counters and releases the previous frame's
+            // transient data
+            void beginFrame() {
+                frameStats = RenderStats{};
+                arena.reset();
+                currentMaterial = noMaterial;
+            }
+
+            // Registers a material and returns its id. Material 0 is plain white.
+            std::uint32_t addMaterial(const Material& material) {
+                materials.push_back(material);
+                return materials.size() - 1;
+            }
+
+            // Selects the material for the following draws, telling the
+            // backend only when it actually changes
+            void useMaterial(const std::uint32_t id) {
+                if (id != currentMaterial) {
+                    currentMaterial = id;
+                    backend->setMaterial(materials.at(id));
+                    ++frameStats.stateChanges;
+                }
+            }
+
+            const RenderStats& stats() const {
+                return frameStats;
+            }
+
+            FrameArena& frameArena() {
+                return arena;
             }
 
             void draw(const Mesh& mesh, const matrix::Matrix4x4 transformMatrix) {
-                sf::VertexArray lines(sf::Lines, mesh.size());
-                for (int i = 0; i < mesh.size(); ++i) {
-                    lines[i].position = raster(transform(mesh[i], transformMatrix));
+                E3D_TRACE_SCOPE("Device::draw");
+                useMaterial(currentMaterial == noMaterial ? 0 : currentMaterial);
+                matrix::Vector3* vertices;
+                {
+                    E3D_PROFILE(prof::Stage::Transform);
+                    vertices = arena.allocate<matrix::Vector3>(mesh.size());
+                    for (size_t i = 0; i < mesh.size(); ++i) {
+                        vertices[i] = transform(mesh[i], transformMatrix);
+                    }
+                    frameStats.verticesTransformed += mesh.size();
                 }
-                window.draw(lines);
+                E3D_PROFILE(prof::Stage::Raster);
+                matrix::Matrix4x4 projection = camera.projectionMatrix();
+                sf::Vector2u size = backend->size();
+                ScreenVertex* points = arena.allocate<ScreenVertex>(mesh.size());
+                for (size_t i = 0; i < mesh.size(); ++i) {
+                    points[i] = project(vertices[i], projection, size);
+                }
+                frameStats.pixelsWritten += backend->drawLines(points, mesh.size(), arena);
+                ++frameStats.drawCalls;
+                frameStats.bytesAllocated = arena.used();
             }
 
             void draw(const Triangle& triangle, const matrix::Matrix4x4& objectToWorldMatrix) {
-                sf::VertexArray lines(sf::LineStrip, 3);
-                matrix::Matrix4x4 transformMatrix = objectToWorldMatrix * camera.cameraToWorldMatrix;
-                lines[0].position = raster(transform(triangle.a, transformMatrix));
-                lines[1].position = raster(transform(triangle.b, transformMatrix));
-                lines[2].position = raster(transform(triangle.c, transformMatrix));
-                lines[3].position = lines[0].position;
-                window.draw(lines);
+                draw(&triangle, 1, objectToWorldMatrix);
+            }
+
+            // Draws 'count' triangles that share an object-to-world matrix
+            void draw(const Triangle* triangles, const size_t count, const matrix::Matrix4x4& objectToWorldMatrix) {
+                E3D_TRACE_SCOPE("Device::draw");
+                useMaterial(currentMaterial == noMaterial ? 0 : currentMaterial);
+                frameStats.trianglesSubmitted += count;
+                matrix::Vector3* vertices;
+                {
+                    E3D_PROFILE(prof::Stage::Transform);
+                    matrix::Matrix4x4 transformMatrix = objectToWorldMatrix * camera.cameraToWorldMatrix;
+                    vertices = arena.allocate<matrix::Vector3>(3 * count);
+                    for (size_t t = 0; t < count; ++t) {
+                        vertices[3 * t] = transform(triangles[t].a, transformMatrix);
+                        vertices[3 * t + 1] = transform(triangles[t].b, transformMatrix);
+                        vertices[3 * t + 2] = transform(triangles[t].c, transformMatrix);
+                    }
+                    frameStats.verticesTransformed += 3 * count;
+                }
+                matrix::Matrix4x4 projection = camera.projectionMatrix();
+                // Each triangle clips to at most 4 vertices, at 4 * t
+                matrix::Vector3* clipped = arena.allocate<matrix::Vector3>(4 * count);
+                VertexAttributes* clippedAttributes = arena.allocate<VertexAttributes>(4 * count);
+                int* clippedCount = arena.allocate<int>(count);
+                {
+                    E3D_PROFILE(prof::Stage::Clip);
+                    for (size_t t = 0; t < count; ++t) {
+                        const matrix::Vector3* polygon = vertices + 3 * t;
+                        int n = 0;
+                        if (!outsideFrustum(polygon, 3, projection, camera.far)) {
+                            n = clipNear(polygon, triangles[t].attributes, 3, clipped + 4 * t,
+                                         clippedAttributes + 4 * t, camera.near);
+                        }
+                        clippedCount[t] = n;
+                        if (n == 0) {
+                            ++frameStats.trianglesCulled;
+                        } else if (polygon[0][2] > -camera.near || polygon[1][2] > -camera.near ||
+                                   polygon[2][2] > -camera.near) {
+                            ++frameStats.trianglesClipped;
+                        }
+                    }
+                }
+                E3D_PROFILE(prof::Stage::Raster);
+                sf::Vector2u size = backend->size();
+                ScreenVertex* screen = arena.allocate<ScreenVertex>(4);
+                for (size_t t = 0; t < count; ++t) {
+                    int n = clippedCount[t];
+                    if (n == 0) {
+                        continue;
+                    }
+                    for (int i = 0; i < n; ++i) {
+                        screen[i] = project(clipped[4 * t + i], projection, size);
+                        screen[i].attributes = clippedAttributes[4 * t + i];
+                    }
+                    frameStats.pixelsWritten += backend->drawPolygon(screen, n, arena);
+                    ++frameStats.drawCalls;
+                }
+                frameStats.bytesAllocated = arena.used();
             }
 
             Camera camera;
 
         private:
-            Window& window;
+            std::unique_ptr<Backend> ownedBackend;
+            Backend* backend;
+            FrameArena arena;
             float aspectRatio;
+            RenderStats frameStats;
+            static constexpr std::uint32_t noMaterial = ~std::uint32_t(0);
+            std::vector<Material> materials {Material{}};
+            std::uint32_t currentMaterial = noMaterial;
 
-            sf::Vector2f raster(matrix::Vector3 point) {
-                matrix::Vector4 hpoint = normalize(homogenize(point) * camera.projectionMatrix());
-                return sf::Vector2f((hpoint[0] + 1) * 0.5 * window.getSize().x,
-                                    (1 - (hpoint[1] + 1) * 0.5) * window.getSize().y);
+            ScreenVertex project(const matrix::Vector3& point, const matrix::Matrix4x4& projection,
+                                 const sf::Vector2u size) const {
+                matrix::Vector4 h = homogenize(point) * projection;
+                matrix::Vector4 hpoint = normalize(h);
+                return ScreenVertex{float((hpoint[0] + 1) * 0.5 * size.x),
+                                    float((1 - (hpoint[1] + 1) * 0.5) * size.y),
+                                    float(hpoint[2]),
+                                    float(h[3] != 0 ? 1 / h[3] : 1),
+                                    VertexAttributes{}};
+            }
+    };
+
+    // Everything needed to draw one object once the frame is submitted
+    struct DrawPacket {
+        const Triangle* triangles;
+        size_t count;
+        matrix::Matrix4x4 objectToWorldMatrix;
+        std::uint32_t material;
+        float depth;
+    };
+
+    // 64-bit sort key, most significant bits first:
+    //   layer (8) | material (24) | camera-space depth (32)
+    // so packets are grouped by layer, then by material to save state changes,
+    // then ordered front to back to save overdraw. Non-negative floats compare
+    // like their bit patterns, which gives the depth ordering for free.
+    inline std::uint64_t makeSortKey(const std::uint8_t layer, const std::uint32_t material, const float depth) {
+        float d = depth > 0 ? depth : 0;
+        std::uint32_t depthBits;
+        std::memcpy(&depthBits, &d, sizeof(depthBits));
+        return (std::uint64_t(layer) << 56) | (std::uint64_t(material & 0xFFFFFF) << 32) | depthBits;
+    }
+
+    // Draw packets recorded during a frame and submitted to a Device later,
+    // in sort key order. The packets live in the frame arena, so clear() must
+    // be called whenever the arena is reset (i.e. after Device::beginFrame).
+    class CommandBuffer {
+        public:
+            explicit CommandBuffer(FrameArena& a) : arena {a} {}
+
+            CommandBuffer(const CommandBuffer&) = delete;
+            CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+            void clear() {
+                packets = nullptr;
+                entries = nullptr;
+                count = 0;
+                capacity = 0;
+            }
+
+            void record(const DrawPacket& packet, const std::uint64_t key) {
+                if (count == capacity) {
+                    grow();
+                }
+                packets[count] = packet;
+                entries[count] = Entry{key, std::uint32_t(count)};
+                ++count;
+            }
+
+            // Appends every packet of 'other', keeping its keys
+            void append(const CommandBuffer& other) {
+                for (size_t i = 0; i < other.count; ++i) {
+                    record(other.packets[other.entries[i].index], other.entries[i].key);
+                }
+            }
+
+            // Stable LSD radix sort of the keys, one byte per pass. Passes in
+            // which every key has the same byte are skipped.
+            void sort() {
+                E3D_TRACE_SCOPE("CommandBuffer::sort");
+                // As large as 'entries', which it replaces after an odd number
+                // of passes, so later records still fit
+                Entry* scratch = arena.allocate<Entry>(capacity);
+                for (int shift = 0; shift < 64; shift += 8) {
+                    size_t histogram[256] = {};
+                    for (size_t i = 0; i < count; ++i) {
+                        ++histogram[(entries[i].key >> shift) & 0xFF];
+                    }
+                    if (count == 0 || histogram[(entries[0].key >> shift) & 0xFF] == count) {
+                        continue;
+                    }
+                    size_t offset = 0;
+                    for (size_t& h : histogram) {
+                        size_t n = h;
+                        h = offset;
+                        offset += n;
+                    }
+                    for (size_t i = 0; i < count; ++i) {
+                        scratch[histogram[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+                    }
+                    std::swap(entries, scratch);
+                }
+            }
+
+            // Draws the packets in order, one batch per run of packets sharing
+            // a material
+            void submit(Device& dev) const {
+                E3D_TRACE_SCOPE("CommandBuffer::submit");
+                size_t i = 0;
+                while (i < count) {
+                    std::uint32_t material = (*this)[i].material;
+                    dev.useMaterial(material);
+                    for (; i < count && (*this)[i].material == material; ++i) {
+                        const DrawPacket& packet = (*this)[i];
+                        dev.draw(packet.triangles, packet.count, packet.objectToWorldMatrix);
+                    }
+                }
+            }
+
+            size_t size() const {
+                return count;
+            }
+
+            // i-th packet in key order, once sorted
+            const DrawPacket& operator[](const size_t i) const {
+                return packets[entries[i].index];
+            }
+
+            std::uint64_t key(const size_t i) const {
+                return entries[i].key;
+            }
+
+        private:
+            struct Entry {
+                std::uint64_t key;
+                std::uint32_t index;
+            };
+
+            FrameArena& arena;
+            DrawPacket* packets = nullptr;
+            Entry* entries = nullptr;
+            size_t count = 0;
+            size_t capacity = 0;
+
+            // The old arrays are abandoned to the arena until its next reset
+            void grow() {
+                size_t newCapacity = capacity ? 2 * capacity : 64;
+                DrawPacket* newPackets = static_cast<DrawPacket*>(arena.allocate(newCapacity * sizeof(DrawPacket), alignof(DrawPacket)));
+                Entry* newEntries = arena.allocate<Entry>(newCapacity);
+                std::copy(packets, packets + count, newPackets);
+                std::copy(entries, entries + count, newEntries);
+                packets = newPackets;
+                entries = newEntries;
+                capacity = newCapacity;
             }
     };
 
@@ -166,9 +607,10 @@ namespace e3d {
                 rotate(0, 0, 0);
             }
             std::vector<Triangle> triangles;
-            matrix::Vector3 position;
-            matrix::Vector3 rotation;
+            matrix::Vector3 position {};
+            matrix::Vector3 rotation {};
             matrix::Matrix4x4 objectToWorldMatrix;
+            std::uint32_t material = 0;
             void move(double x, double y, double z) {
                 position = position + matrix::Vector3{x, y, z};
                 traslationMatrix = computeTraslationMatrix();
@@ -186,9 +628,16 @@ namespace e3d {
                 setRotation(rotation + matrix::Vector3{xrot, yrot, zrot});
             }
              void draw(e3d::Device& dev) {
-                for (auto triangle : triangles) {
-                    dev.draw(triangle, objectToWorldMatrix);
-                }
+                E3D_TRACE_SCOPE("Poly::draw");
+                dev.useMaterial(material);
+                dev.draw(triangles.data(), triangles.size(), objectToWorldMatrix);
+            }
+            // Records a draw packet instead of drawing right away
+            void record(CommandBuffer& commands, const Camera& camera, const std::uint8_t layer = 0) const {
+                matrix::Vector4 origin = matrix::Vector4{0, 0, 0, 1} * (objectToWorldMatrix * camera.cameraToWorldMatrix);
+                float depth = -origin[2];
+                commands.record(DrawPacket{triangles.data(), triangles.size(), objectToWorldMatrix, material, depth},
+                                makeSortKey(layer, material, depth));
             }
         private:
             matrix::Matrix4x4 traslationMatrix;
@@ -236,6 +685,37 @@ namespace e3d {
             }
      };
 
+    // Cube from -1 to 1 on every axis, two triangles per face. Every face
+    // is textured with the whole texture and has the face normal at its corners.
+    inline Poly makeCube() {
+        Poly cube;
+        cube.triangles.push_back({{-1, -1, 1}, {1, -1, -1}, {1, -1, 1}});
+        cube.triangles.push_back({{-1, -1, 1}, {-1, -1, -1}, {1, -1, -1}});
+        cube.triangles.push_back({{-1, 1, 1}, {1, 1, 1}, {1, 1, -1}});
+        cube.triangles.push_back({{-1, 1, 1}, {1, 1, -1}, {-1, 1, -1}});
+        cube.triangles.push_back({{-1, -1, 1}, {1, -1, 1}, {1, 1, 1}});
+        cube.triangles.push_back({{-1, -1, 1}, {1, 1, 1}, {-1, 1, 1}});
+        cube.triangles.push_back({{-1, -1, -1}, {1, 1, -1}, {1, -1, -1}});
+        cube.triangles.push_back({{-1, -1, -1}, {-1, 1, -1}, {1, 1, -1}});
+        cube.triangles.push_back({{-1, -1, -1}, {-1, 1, 1}, {-1, 1, -1}});
+        cube.triangles.push_back({{-1, -1, -1}, {-1, -1, 1}, {-1, 1, 1}});
+        cube.triangles.push_back({{1, -1, 1}, {1, -1, -1}, {1, 1, -1}});
+        cube.triangles.push_back({{1, -1, 1}, {1, 1, -1}, {1, 1, 1}});
+        for (Triangle& t : cube.triangles) {
+            // The axis the face is perpendicular to, and the two spanning it
+            int axis = t.a[0] == t.b[0] && t.b[0] == t.c[0] ? 0 : t.a[1] == t.b[1] && t.b[1] == t.c[1] ? 1 : 2;
+            int uAxis = axis == 0 ? 1 : 0, vAxis = axis == 2 ? 1 : 2;
+            const matrix::Vector3* corners[3] = {&t.a, &t.b, &t.c};
+            for (int i = 0; i < 3; ++i) {
+                t.normals[i] = matrix::Vector3{};
+                t.normals[i][axis] = t.a[axis];
+                t.attributes[i].u = float(((*corners[i])[uAxis] + 1) / 2);
+                t.attributes[i].v = float(((*corners[i])[vAxis] + 1) / 2);
+            }
+        }
+        return cube;
+    }
+
 }
 
 #endif // ENGINE3D_H_
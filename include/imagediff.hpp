@@ -0,0 +1,77 @@
+#ifndef IMAGEDIFF_H_
+#define IMAGEDIFF_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <SFML/Graphics/Image.hpp>
+
+// Perceptual image comparison for golden-image tests
+//
+// Pixels are compared by their distance in YIQ space, weighted towards
+// brightness the way the eye is (Kotsarenko and Ramos, "Measuring perceived
+// color difference using YIQ NTSC transmission color space", as used by
+// pixelmatch). Translucent pixels are blended over white first.
+
+namespace e3d {
+
+    struct ImageDiff {
+        size_t mismatched = 0;  // pixels over the threshold
+        double maxDelta = 0;    // largest difference, 0 to 1
+        sf::Image diff;         // faded expected image with mismatches in red
+    };
+
+    // Perceived difference between two RGBA colors, from 0 (same) to 1 (the
+    // largest possible); black against white is about 0.97
+    inline double colorDelta(const std::uint8_t* a, const std::uint8_t* b) {
+        double rgb[2][3];
+        for (int i = 0; i < 3; ++i) {
+            rgb[0][i] = 255 + (a[i] - 255) * (a[3] / 255.0);
+            rgb[1][i] = 255 + (b[i] - 255) * (b[3] / 255.0);
+        }
+        auto y = [](const double* c) { return c[0] * 0.29889531 + c[1] * 0.58662247 + c[2] * 0.11448223; };
+        auto i = [](const double* c) { return c[0] * 0.59597799 - c[1] * 0.27417610 - c[2] * 0.32180189; };
+        auto q = [](const double* c) { return c[0] * 0.21147017 - c[1] * 0.52261711 + c[2] * 0.31114694; };
+        double dy = y(rgb[0]) - y(rgb[1]);
+        double di = i(rgb[0]) - i(rgb[1]);
+        double dq = q(rgb[0]) - q(rgb[1]);
+        // 35215 is the largest possible squared delta
+        return std::sqrt((0.5053 * dy * dy + 0.299 * di * di + 0.1957 * dq * dq) / 35215);
+    }
+
+    // Counts the pixels of 'actual' whose colorDelta from 'expected' exceeds
+    // 'threshold'. Images of different sizes mismatch everywhere.
+    inline ImageDiff compareImages(const sf::Image& expected, const sf::Image& actual, const double threshold = 0.1) {
+        ImageDiff result;
+        sf::Vector2u size = expected.getSize();
+        if (size != actual.getSize()) {
+            result.mismatched = std::max(size_t(size.x) * size.y,
+                                         size_t(actual.getSize().x) * actual.getSize().y);
+            result.maxDelta = 1;
+            return result;
+        }
+        result.diff.create(size.x, size.y);
+        const std::uint8_t* e = expected.getPixelsPtr();
+        const std::uint8_t* a = actual.getPixelsPtr();
+        for (unsigned int y = 0; y < size.y; ++y) {
+            for (unsigned int x = 0; x < size.x; ++x) {
+                size_t i = (size_t(y) * size.x + x) * 4;
+                double delta = colorDelta(e + i, a + i);
+                result.maxDelta = std::max(result.maxDelta, delta);
+                if (delta > threshold) {
+                    ++result.mismatched;
+                    result.diff.setPixel(x, y, sf::Color::Red);
+                }
+                else {
+                    // Grey, faded version of the expected pixel for context
+                    sf::Uint8 grey = sf::Uint8(255 - (255 - (e[i] * 3 + e[i + 1] * 6 + e[i + 2]) / 10) / 4);
+                    result.diff.setPixel(x, y, sf::Color(grey, grey, grey));
+                }
+            }
+        }
+        return result;
+    }
+
+}
+
+#endif // IMAGEDIFF_H_
@@ -0,0 +1,499 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "trace.hpp"
+
+// Work-stealing job system
+//
+// Every worker thread owns a Chase-Lev deque: it pushes and pops jobs at the
+// bottom, while idle workers steal from the top. Jobs submitted from threads
+// that are not workers go through a shared injection queue. Completion is
+// tracked with counters: run() increments a counter, the job decrements it
+// when done, and wait() executes other jobs until the counter reaches zero.
+// Jobs may also be made to depend on a counter with runAfter(). Jobs are
+// recycled and hold small tasks in place, so once the pool has warmed up,
+// running jobs doesn't touch the heap.
+//
+//     jobs::Counter done;
+//     jobs::scheduler().run([] { ... }, done);
+//     jobs::scheduler().parallelFor(0, n, 1024, [&](size_t begin, size_t end) { ... });
+//     jobs::scheduler().wait(done);
+
+namespace jobs {
+
+    // Lock-free single-owner deque (Chase and Lev, with the memory orderings of
+    // Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+    // Fixed capacity: push() returns false when full.
+    template <typename T>
+    class WorkStealingDeque {
+        public:
+            explicit WorkStealingDeque(const size_t capacity = 4096)
+                : mask {roundUp(capacity) - 1}, buffer {new std::atomic<T*>[mask + 1]} {}
+
+            // Owner only
+            bool push(T* item) {
+                std::int64_t b = bottom.load(std::memory_order_relaxed);
+                std::int64_t t = top.load(std::memory_order_acquire);
+                if (b - t > std::int64_t(mask)) {
+                    return false;
+                }
+                // The release store also publishes the item to thieves through
+                // the slot itself, which ThreadSanitizer can follow (it ignores fences)
+                buffer[b & mask].store(item, std::memory_order_release);
+                std::atomic_thread_fence(std::memory_order_release);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return true;
+            }
+
+            // Owner only
+            T* pop() {
+                std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+                bottom.store(b, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                std::int64_t t = top.load(std::memory_order_relaxed);
+                if (t > b) {
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                T* item = buffer[b & mask].load(std::memory_order_relaxed);
+                if (t == b) {
+                    // Last item: race the thieves for it
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                        item = nullptr;
+                    }
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+                return item;
+            }
+
+            // Any thread
+            T* steal() {
+                std::int64_t t = top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                std::int64_t b = bottom.load(std::memory_order_acquire);
+                if (t >= b) {
+                    return nullptr;
+                }
+                T* item = buffer[t & mask].load(std::memory_order_acquire);
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    return nullptr;
+                }
+                return item;
+            }
+
+            bool empty() const {
+                return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+            }
+
+        private:
+            alignas(64) std::atomic<std::int64_t> top {0};
+            alignas(64) std::atomic<std::int64_t> bottom {0};
+            size_t mask;
+            std::unique_ptr<std::atomic<T*>[]> buffer;
+
+            static size_t roundUp(const size_t n) {
+                size_t p = 1;
+                while (p < n) {
+                    p *= 2;
+                }
+                return p;
+            }
+    };
+
+    class JobSystem;
+
+    class Counter;
+
+    // A task and the counter it decrements when done. Tasks up to
+    // inlineSize bytes are stored in the job itself; larger ones on the heap.
+    class Job {
+        public:
+            static constexpr size_t inlineSize = 64;
+
+            Job() = default;
+            Job(const Job&) = delete;
+            Job& operator=(const Job&) = delete;
+
+            template <typename F>
+            void set(F&& task, Counter& c) {
+                using Task = std::decay_t<F>;
+                counter = &c;
+                if constexpr (sizeof(Task) <= inlineSize && alignof(Task) <= alignof(std::max_align_t)) {
+                    new (storage) Task(std::forward<F>(task));
+                    call = [](void* p) { (*static_cast<Task*>(p))(); };
+                    destroy = [](void* p) { static_cast<Task*>(p)->~Task(); };
+                }
+                else {
+                    new (storage) Task*(new Task(std::forward<F>(task)));
+                    call = [](void* p) { (**static_cast<Task**>(p))(); };
+                    destroy = [](void* p) { delete *static_cast<Task**>(p); };
+                }
+            }
+
+            // Runs the task, then destroys it
+            void operator()() {
+                call(storage);
+                destroy(storage);
+            }
+
+            Counter* counter = nullptr;
+            Job* next = nullptr;  // in the injection queue or a free list
+
+        private:
+            alignas(std::max_align_t) unsigned char storage[inlineSize];
+            void (*call)(void*) = nullptr;
+            void (*destroy)(void*) = nullptr;
+    };
+
+    // Number of unfinished jobs, plus jobs waiting for it to reach zero
+    class Counter {
+        public:
+            bool done() const {
+                return pending.load(std::memory_order_acquire) == 0;
+            }
+
+        private:
+            friend class JobSystem;
+            std::atomic<int> pending {0};
+            std::mutex mutex;
+            std::vector<Job*> continuations;
+    };
+
+    class JobSystem {
+        public:
+            // 'threads' workers are started; a thread calling wait() helps too
+            explicit JobSystem(const int threads = defaultThreads()) {
+                int n = std::max(threads, 1);
+                for (int i = 0; i < n; ++i) {
+                    queues.push_back(std::make_unique<WorkStealingDeque<Job>>());
+                }
+                // The free lists start full, so running jobs doesn't allocate
+                // while finished jobs drift from one list to another
+                freeJobs = std::make_unique<FreeList[]>(n);
+                for (int i = 0; i < n; ++i) {
+                    for (int j = 0; j < spareJobs; ++j) {
+                        push(freeJobs[i].head, new Job);
+                        push(sharedJobs, new Job);
+                    }
+                    freeJobs[i].size = spareJobs;
+                }
+                for (int i = 0; i < n; ++i) {
+                    workers.emplace_back([this, i] { workerLoop(i); });
+                }
+            }
+
+            // All submitted work must have been waited for
+            ~JobSystem() {
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    stopping = true;
+                }
+                wake.notify_all();
+                for (auto& w : workers) {
+                    w.join();
+                }
+                for (size_t i = 0; i < workers.size(); ++i) {
+                    deleteJobs(freeJobs[i].head);
+                }
+                deleteJobs(sharedJobs);
+            }
+
+            JobSystem(const JobSystem&) = delete;
+            JobSystem& operator=(const JobSystem&) = delete;
+
+            template <typename F>
+            void run(F&& task, Counter& counter) {
+                counter.pending.fetch_add(1, std::memory_order_relaxed);
+                Job* job = allocate();
+                job->set(std::forward<F>(task), counter);
+                enqueue(job);
+            }
+
+            // Runs 'task' once 'dependency' reaches zero
+            template <typename F>
+            void runAfter(Counter& dependency, F&& task, Counter& counter) {
+                counter.pending.fetch_add(1, std::memory_order_relaxed);
+                Job* job = allocate();
+                job->set(std::forward<F>(task), counter);
+                {
+                    std::lock_guard<std::mutex> lock(dependency.mutex);
+                    if (!dependency.done()) {
+                        dependency.continuations.push_back(job);
+                        return;
+                    }
+                }
+                enqueue(job);
+            }
+
+            // Executes jobs until 'counter' reaches zero. The counter may be
+            // destroyed as soon as this returns.
+            void wait(Counter& counter) {
+                int index = currentIndex();
+                while (!counter.done()) {
+                    if (Job* job = take(index)) {
+                        execute(job);
+                    }
+                    else {
+                        std::this_thread::yield();
+                    }
+                }
+                // The last job publishes zero while holding the mutex; taking it
+                // here waits until that job is done with the counter
+                std::lock_guard<std::mutex> lock(counter.mutex);
+            }
+
+            // Calls fn(begin, end) over subranges of at most 'grain' items,
+            // splitting recursively so idle workers can steal the larger halves
+            template <typename F>
+            void parallelFor(const size_t begin, const size_t end, const size_t grain, F&& fn) {
+                Counter counter;
+                split(begin, end, std::max<size_t>(grain, 1), fn, counter);
+                wait(counter);
+            }
+
+            size_t threadCount() const {
+                return workers.size();
+            }
+
+            static int defaultThreads() {
+                int n = std::thread::hardware_concurrency();
+                return std::max(n - 1, 1);
+            }
+
+        private:
+            std::vector<std::unique_ptr<WorkStealingDeque<Job>>> queues;
+            std::vector<std::thread> workers;
+            std::mutex injectionMutex;
+            Job* injectionHead = nullptr;  // FIFO linked through Job::next
+            Job* injectionTail = nullptr;
+            std::atomic<int> queued {0};
+            std::atomic<int> sleeping {0};
+            std::mutex sleepMutex;
+            std::condition_variable wake;
+            bool stopping = false;
+
+            // Finished jobs are kept for reuse. Each worker has its own free
+            // list of up to spareJobs jobs; other threads, and workers with a
+            // full list, share one under a mutex that starts with spareJobs
+            // jobs per worker.
+            static constexpr int spareJobs = 64;
+            struct alignas(64) FreeList {
+                Job* head = nullptr;
+                int size = 0;
+            };
+            std::unique_ptr<FreeList[]> freeJobs;
+            std::mutex poolMutex;
+            Job* sharedJobs = nullptr;
+
+            struct WorkerIdentity {
+                JobSystem* system = nullptr;
+                int index = -1;
+                std::uint32_t seed = 1;
+            };
+
+            static WorkerIdentity& identity() {
+                thread_local WorkerIdentity id;
+                return id;
+            }
+
+            // Index of the calling thread's deque, or -1 if it isn't one of our workers
+            int currentIndex() const {
+                return identity().system == this ? identity().index : -1;
+            }
+
+            Job* allocate() {
+                int index = currentIndex();
+                if (index >= 0 && freeJobs[index].head) {
+                    Job* job = freeJobs[index].head;
+                    freeJobs[index].head = job->next;
+                    --freeJobs[index].size;
+                    return job;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(poolMutex);
+                    if (Job* job = sharedJobs) {
+                        sharedJobs = job->next;
+                        return job;
+                    }
+                }
+                return new Job;
+            }
+
+            void release(Job* job) {
+                int index = currentIndex();
+                if (index >= 0 && freeJobs[index].size < spareJobs) {
+                    push(freeJobs[index].head, job);
+                    ++freeJobs[index].size;
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(poolMutex);
+                push(sharedJobs, job);
+            }
+
+            static void push(Job*& list, Job* job) {
+                job->next = list;
+                list = job;
+            }
+
+            static void deleteJobs(Job* job) {
+                while (job) {
+                    Job* next = job->next;
+                    delete job;
+                    job = next;
+                }
+            }
+
+            void enqueue(Job* job) {
+                int index = currentIndex();
+                if (index < 0 || !queues[index]->push(job)) {
+                    std::lock_guard<std::mutex> lock(injectionMutex);
+                    job->next = nullptr;
+                    if (injectionTail) {
+                        injectionTail->next = job;
+                    }
+                    else {
+                        injectionHead = job;
+                    }
+                    injectionTail = job;
+                }
+                queued.fetch_add(1, std::memory_order_seq_cst);
+                if (sleeping.load(std::memory_order_seq_cst) > 0) {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    wake.notify_one();
+                }
+            }
+
+            Job* take(const int index) {
+                Job* job = nullptr;
+                if (index >= 0) {
+                    job = queues[index]->pop();
+                }
+                if (!job && queued.load(std::memory_order_relaxed) > 0) {
+                    std::lock_guard<std::mutex> lock(injectionMutex);
+                    if (injectionHead) {
+                        job = injectionHead;
+                        injectionHead = job->next;
+                        if (!injectionHead) {
+                            injectionTail = nullptr;
+                        }
+                    }
+                }
+                if (!job) {
+                    job = steal(index);
+                }
+                if (job) {
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                }
+                return job;
+            }
+
+            Job* steal(const int index) {
+                std::uint32_t& seed = identity().seed;
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                size_t n = queues.size();
+                size_t start = seed % n;
+                for (size_t i = 0; i < n; ++i) {
+                    size_t victim = (start + i) % n;
+                    if (int(victim) == index) {
+                        continue;
+                    }
+                    if (Job* job = queues[victim]->steal()) {
+                        return job;
+                    }
+                }
+                return nullptr;
+            }
+
+            void execute(Job* job) {
+                (*job)();
+                Counter& counter = *job->counter;
+                release(job);
+                // Jobs that can't be the last one leave without touching the
+                // counter again
+                int n = counter.pending.load(std::memory_order_relaxed);
+                while (n > 1) {
+                    if (counter.pending.compare_exchange_weak(n, n - 1, std::memory_order_acq_rel,
+                                                              std::memory_order_relaxed)) {
+                        return;
+                    }
+                }
+                // Otherwise zero is published and the continuations taken under
+                // the mutex, so a waiter can't free the counter while we hold it
+                std::vector<Job*> ready;
+                {
+                    std::lock_guard<std::mutex> lock(counter.mutex);
+                    if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        ready.swap(counter.continuations);
+                    }
+                }
+                for (Job* next : ready) {
+                    enqueue(next);
+                }
+            }
+
+            void workerLoop(const int index) {
+                identity().system = this;
+                identity().index = index;
+                identity().seed = 2654435761u * (index + 1);
+                E3D_TRACE_THREAD_NAME("Job worker " + std::to_string(index));
+                int idle = 0;
+                while (true) {
+                    if (Job* job = take(index)) {
+                        execute(job);
+                        idle = 0;
+                        continue;
+                    }
+                    if (++idle < 64) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    sleeping.fetch_add(1, std::memory_order_seq_cst);
+                    wake.wait(lock, [this] {
+                        return stopping || queued.load(std::memory_order_seq_cst) > 0;
+                    });
+                    sleeping.fetch_sub(1, std::memory_order_seq_cst);
+                    if (stopping) {
+                        return;
+                    }
+                    idle = 0;
+                }
+            }
+
+            template <typename F>
+            void split(size_t begin, size_t end, const size_t grain, F& fn, Counter& counter) {
+                while (end - begin > grain) {
+                    size_t mid = begin + (end - begin) / 2;
+                    run([this, mid, end, grain, &fn, &counter] { split(mid, end, grain, fn, counter); }, counter);
+                    end = mid;
+                }
+                if (begin < end) {
+                    fn(begin, end);
+                }
+            }
+    };
+
+    // Engine-wide job system, started on first use
+    inline JobSystem& scheduler() {
+        static JobSystem instance;
+        return instance;
+    }
+
+}
+
+#endif // JOBS_H_
@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <functional>
 #include <numeric>
+#include <cmath>
+#include <stdexcept>
 
 namespace matrix {
 // A Row is a row of doubles
@@ -77,7 +79,7 @@ const matrix::Row<C> operator-(const matrix::Row<C>& a, const matrix::Row<C>& b)
 
 template<size_t C>
 double operator*(const matrix::Row<C> & a, const matrix::Row<3>& b) {
-    return std::inner_product(a.begin(), a.end(), b.begin(), 0);
+    return std::inner_product(a.begin(), a.end(), b.begin(), 0.0);
 }
 
 template<size_t C>
@@ -143,6 +145,37 @@ const matrix::Row<C> operator*(const matrix::Row<R>& r, const matrix::Matrix<R,
     return result;
 }
 
+// Inverse of a square matrix, by Gauss-Jordan elimination with partial pivoting
+template<size_t R>
+const matrix::Matrix<R, R> inverse(const matrix::Matrix<R, R>& a) {
+    matrix::Matrix<R, R> m = a;
+    matrix::Matrix<R, R> result = matrix::I<R>();
+    for (size_t j = 0; j < R; ++j) {
+        size_t pivot = j;
+        for (size_t i = j + 1; i < R; ++i) {
+            if (std::abs(m[i][j]) > std::abs(m[pivot][j])) {
+                pivot = i;
+            }
+        }
+        if (m[pivot][j] == 0) {
+            throw std::domain_error("inverse: matrix is singular");
+        }
+        std::swap(m[j], m[pivot]);
+        std::swap(result[j], result[pivot]);
+        double k = 1 / m[j][j];
+        m[j] = k * m[j];
+        result[j] = k * result[j];
+        for (size_t i = 0; i < R; ++i) {
+            if (i != j && m[i][j] != 0) {
+                double f = m[i][j];
+                m[i] = m[i] - f * m[j];
+                result[i] = result[i] - f * result[j];
+            }
+        }
+    }
+    return result;
+}
+
 const matrix::Vector4 normalize(const matrix::Vector4& v) {
     if (v[3] != 0 && v[3] != 1) {
         return matrix::Vector4 {v[0]/v[3], v[1]/v[3], v[2]/v[3], 1};
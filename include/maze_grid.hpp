@@ -0,0 +1,124 @@
+#ifndef maze_grid_hpp
+#define maze_grid_hpp
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <SFML/System/Vector2.hpp>
+
+enum class CellType : std::uint8_t
+{
+  Wall,
+  Corridor,
+  Exit
+};
+
+// The cells of a maze as one byte each, row by row
+//
+// Pathfinding and collision only need to know what each cell is, so they
+// can walk this packed array instead of the cells' sprites: a 1000x1000 maze
+// is a megabyte. Cells are numbered row by row from the top left corner, and
+// positions are {row, col} like the maze's dimension.
+class Maze_grid
+{
+public:
+  Maze_grid(sf::Vector2i dimension = {8, 8}, CellType fill = CellType::Wall);
+
+  sf::Vector2i dimension() const;
+  int size() const;
+  CellType type(int cell_num) const;
+  void set_type(int cell_num, CellType type);
+  bool can_enter(int cell_num) const;
+  bool inside(sf::Vector2i pos) const;
+  int cell_num(sf::Vector2i pos) const;
+  sf::Vector2i position(int cell_num) const;
+  int neighbours(int cell_num, std::array<int, 4> &out) const;
+  std::vector<int> neighbours(int cell_num) const;
+  const CellType *data() const;
+
+private:
+  sf::Vector2i dimension_;
+  std::vector<CellType> cells_;
+};
+
+inline Maze_grid::Maze_grid(sf::Vector2i dimension, CellType fill)
+    : dimension_{dimension},
+      cells_(std::size_t(std::max(dimension.x, 0)) * std::max(dimension.y, 0), fill)
+{
+}
+
+inline sf::Vector2i Maze_grid::dimension() const
+{
+  return dimension_;
+}
+
+inline int Maze_grid::size() const
+{
+  return int(cells_.size());
+}
+
+inline CellType Maze_grid::type(int cell_num) const
+{
+  assert(cell_num >= 0 && cell_num < size());
+  return cells_[cell_num];
+}
+
+inline void Maze_grid::set_type(int cell_num, CellType type)
+{
+  assert(cell_num >= 0 && cell_num < size());
+  cells_[cell_num] = type;
+}
+
+// Corridors and the exit can be walked into; walls and cells outside can't
+inline bool Maze_grid::can_enter(int cell_num) const
+{
+  return cell_num >= 0 && cell_num < size() && cells_[cell_num] != CellType::Wall;
+}
+
+inline bool Maze_grid::inside(sf::Vector2i pos) const
+{
+  return pos.x >= 0 && pos.x < dimension_.x && pos.y >= 0 && pos.y < dimension_.y;
+}
+
+// -1 for positions outside the grid
+inline int Maze_grid::cell_num(sf::Vector2i pos) const
+{
+  return inside(pos) ? pos.x * dimension_.y + pos.y : -1;
+}
+
+inline sf::Vector2i Maze_grid::position(int cell_num) const
+{
+  return {cell_num / dimension_.y, cell_num % dimension_.y};
+}
+
+// Writes the cells above, below, left and right of 'cell_num' that are
+// inside the grid, whatever their type, to 'out'; returns how many there are
+inline int Maze_grid::neighbours(int cell_num, std::array<int, 4> &out) const
+{
+  const sf::Vector2i pos = position(cell_num);
+  const sf::Vector2i steps[4] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+  int count = 0;
+  for (const sf::Vector2i step : steps)
+  {
+    if (inside(pos + step))
+      out[count++] = cell_num + step.x * dimension_.y + step.y;
+  }
+  return count;
+}
+
+inline std::vector<int> Maze_grid::neighbours(int cell_num) const
+{
+  std::array<int, 4> found;
+  int count = neighbours(cell_num, found);
+  return std::vector<int>(found.begin(), found.begin() + count);
+}
+
+inline const CellType *Maze_grid::data() const
+{
+  return cells_.data();
+}
+
+#endif
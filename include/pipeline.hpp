@@ -0,0 +1,141 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "engine3d.hpp"
+
+// Pipelined simulation and rendering
+//
+// The simulation of frame N+1 runs on its own thread while frame N renders.
+// Frames are handed over through two state slots: frame f lives in slot
+// f % 2, and two counters (last frame published, last frame released) tell
+// each side when its next slot is ready, so the handoff never takes a lock.
+
+namespace e3d {
+
+    // Single producer, single consumer, frames consumed in order
+    template <typename State>
+    class FramePipeline {
+        public:
+            explicit FramePipeline(const State& initial = State()) : slots {initial, initial} {}
+
+            // Producer: the slot for the next frame, once the consumer is done
+            // with the frame that used it before. nullptr after stop().
+            State* beginWrite() {
+                std::uint64_t frame = written + 1;
+                if (!waitFor(released, frame < 2 ? 0 : frame - 2)) {
+                    return nullptr;
+                }
+                return &slots[frame % 2];
+            }
+
+            void endWrite() {
+                published.store(++written, std::memory_order_release);
+            }
+
+            // Consumer: the next frame, once it has been published. nullptr
+            // after stop().
+            const State* beginRead() {
+                std::uint64_t frame = read + 1;
+                if (!waitFor(published, frame)) {
+                    return nullptr;
+                }
+                return &slots[frame % 2];
+            }
+
+            void endRead() {
+                released.store(++read, std::memory_order_release);
+            }
+
+            // Wakes up both sides for good
+            void stop() {
+                stopping.store(true, std::memory_order_release);
+            }
+
+            bool stopped() const {
+                return stopping.load(std::memory_order_acquire);
+            }
+
+        private:
+            State slots[2];
+            alignas(64) std::atomic<std::uint64_t> published {0};
+            alignas(64) std::atomic<std::uint64_t> released {0};
+            alignas(64) std::atomic<bool> stopping {false};
+            std::uint64_t written = 0;  // producer only
+            std::uint64_t read = 0;     // consumer only
+
+            bool waitFor(const std::atomic<std::uint64_t>& counter, const std::uint64_t frame) const {
+                while (counter.load(std::memory_order_acquire) < frame) {
+                    if (stopped()) {
+                        return false;
+                    }
+                    std::this_thread::yield();
+                }
+                return true;
+            }
+    };
+
+    // Runs 'step' on a simulation thread, once per frame, each time into the
+    // next free slot of a FramePipeline that the render thread consumes
+    template <typename State>
+    class PipelinedSimulation {
+        public:
+            PipelinedSimulation(std::function<void(State&)> s, const State& initial = State())
+                : pipeline {initial}, step {std::move(s)}, thread {[this] { run(); }} {}
+
+            ~PipelinedSimulation() {
+                pipeline.stop();
+                thread.join();
+            }
+
+            PipelinedSimulation(const PipelinedSimulation&) = delete;
+            PipelinedSimulation& operator=(const PipelinedSimulation&) = delete;
+
+            // Render thread: the oldest simulated frame not yet rendered
+            const State* beginFrame() {
+                return pipeline.beginRead();
+            }
+
+            void endFrame() {
+                pipeline.endRead();
+            }
+
+        private:
+            FramePipeline<State> pipeline;
+            std::function<void(State&)> step;
+            std::thread thread;
+
+            void run() {
+                E3D_TRACE_THREAD_NAME("simulation");
+                while (State* state = pipeline.beginWrite()) {
+                    step(*state);
+                    pipeline.endWrite();
+                }
+            }
+    };
+
+    // Everything the renderer needs from the simulation: one transform per object
+    struct SceneSnapshot {
+        std::vector<matrix::Matrix4x4> transforms;
+    };
+
+    inline void capture(const std::vector<const Poly*>& scene, SceneSnapshot& snapshot) {
+        snapshot.transforms.resize(scene.size());
+        for (size_t i = 0; i < scene.size(); ++i) {
+            snapshot.transforms[i] = scene[i]->objectToWorldMatrix;
+        }
+    }
+
+    inline void apply(const SceneSnapshot& snapshot, const std::vector<Poly*>& scene) {
+        for (size_t i = 0; i < scene.size() && i < snapshot.transforms.size(); ++i) {
+            scene[i]->objectToWorldMatrix = snapshot.transforms[i];
+        }
+    }
+
+}
+
+#endif // PIPELINE_H_
@@ -0,0 +1,152 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+// Frame profiler
+//
+// Scoped timers accumulate the time spent in each stage of the frame. At the
+// end of every frame the totals are pushed into a ring buffer that keeps the
+// last 'history' frames, from which min/avg/p99 statistics are computed.
+//
+//     {
+//         E3D_PROFILE(prof::Stage::Raster);
+//         ...
+//     }
+
+namespace prof {
+
+    enum class Stage {
+        Events,
+        Transform,
+        Clip,
+        Raster,
+        ImGui,
+        Count
+    };
+
+    constexpr size_t stageCount = size_t(Stage::Count);
+
+    inline const char* stageName(const Stage stage) {
+        static const char* names[stageCount] = {"Events", "Transform", "Clip", "Raster", "ImGui"};
+        return names[size_t(stage)];
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    // Time spent in each stage during one frame, in milliseconds
+    struct FrameSample {
+        std::array<double, stageCount> stages {};
+        double total = 0;
+    };
+
+    struct Stats {
+        double min = 0;
+        double avg = 0;
+        double p99 = 0;
+    };
+
+    class FrameProfiler {
+        public:
+            static constexpr size_t history = 240;
+
+            void beginFrame() {
+                current = FrameSample{};
+                frameStart = Clock::now();
+            }
+
+            void endFrame() {
+                current.total = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+                samples[next] = current;
+                next = (next + 1) % history;
+                count = std::min(count + 1, history);
+            }
+
+            void add(const Stage stage, const Clock::duration elapsed) {
+                current.stages[size_t(stage)] += std::chrono::duration<double, std::milli>(elapsed).count();
+            }
+
+            // Number of frames recorded, up to 'history'
+            size_t size() const {
+                return count;
+            }
+
+            // Recorded frame 'age' frames ago; 0 is the last finished frame
+            const FrameSample& sample(const size_t age) const {
+                return samples[(next + history - 1 - age) % history];
+            }
+
+            Stats stats(const Stage stage) const {
+                return computeStats([stage](const FrameSample& s) { return s.stages[size_t(stage)]; });
+            }
+
+            Stats frameStats() const {
+                return computeStats([](const FrameSample& s) { return s.total; });
+            }
+
+            bool enabled = true;
+
+        private:
+            std::array<FrameSample, history> samples {};
+            size_t next = 0;
+            size_t count = 0;
+            FrameSample current;
+            Clock::time_point frameStart = Clock::now();
+
+            template <typename F>
+            Stats computeStats(F value) const {
+                Stats result;
+                if (count == 0) {
+                    return result;
+                }
+                std::array<double, history> values;
+                double sum = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    values[i] = value(sample(i));
+                    sum += values[i];
+                }
+                size_t p = std::min(count - 1, count * 99 / 100);
+                std::nth_element(values.begin(), values.begin() + p, values.begin() + count);
+                result.p99 = values[p];
+                result.min = *std::min_element(values.begin(), values.begin() + count);
+                result.avg = sum / count;
+                return result;
+            }
+    };
+
+    inline FrameProfiler& profiler() {
+        static FrameProfiler instance;
+        return instance;
+    }
+
+    // Adds the lifetime of the timer to 'stage' in the current frame
+    class ScopedTimer {
+        public:
+            explicit ScopedTimer(const Stage s) : stage {s}, active {profiler().enabled} {
+                if (active) {
+                    start = Clock::now();
+                }
+            }
+            ~ScopedTimer() {
+                if (active) {
+                    profiler().add(stage, Clock::now() - start);
+                }
+            }
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        private:
+            Stage stage;
+            bool active;
+            Clock::time_point start;
+    };
+
+}
+
+#define E3D_PROFILE_CONCAT_(a, b) a##b
+#define E3D_PROFILE_CONCAT(a, b) E3D_PROFILE_CONCAT_(a, b)
+#define E3D_PROFILE(stage) prof::ScopedTimer E3D_PROFILE_CONCAT(e3dProfileTimer, __LINE__)(stage)
+
+#endif // PROFILER_H_
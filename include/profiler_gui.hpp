@@ -0,0 +1,117 @@
+#ifndef PROFILER_GUI_H_
+#define PROFILER_GUI_H_
+
+#include <algorithm>
+#include "imgui.h"
+#include "profiler.hpp"
+#include "engine3d.hpp"
+
+// ImGui overlays for the frame profiler and the Device render statistics.
+// Kept apart from profiler.hpp so the profiler itself can be used by targets
+// built without ImGui.
+
+namespace prof {
+
+    inline ImU32 stageColor(const Stage stage) {
+        static const ImU32 colors[stageCount] = {
+            IM_COL32(230, 159, 0, 255),
+            IM_COL32(86, 180, 233, 255),
+            IM_COL32(0, 158, 115, 255),
+            IM_COL32(213, 94, 0, 255),
+            IM_COL32(204, 121, 167, 255)
+        };
+        return colors[size_t(stage)];
+    }
+
+    // Timeline of the recorded frames, newest on the right. Each column is a
+    // frame, split into the time spent in each stage; the grey remainder is
+    // time not covered by any stage.
+    inline void drawTimeline(const FrameProfiler& p, const float height = 80) {
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+        float barWidth = width / FrameProfiler::history;
+        double scale = std::max(p.frameStats().p99, 1.0);
+
+        drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + height), IM_COL32(20, 20, 20, 255));
+        for (size_t age = 0; age < p.size(); ++age) {
+            const FrameSample& sample = p.sample(age);
+            float x1 = origin.x + width - age * barWidth;
+            float x0 = x1 - barWidth;
+            float y = origin.y + height;
+            float total = std::min(float(sample.total / scale), 1.0f) * height;
+            drawList->AddRectFilled(ImVec2(x0, y - total), ImVec2(x1, y), IM_COL32(90, 90, 90, 255));
+            for (size_t s = 0; s < stageCount; ++s) {
+                float h = float(sample.stages[s] / scale) * height;
+                float top = std::max(y - h, origin.y);
+                drawList->AddRectFilled(ImVec2(x0, top), ImVec2(x1, y), stageColor(Stage(s)));
+                y = top;
+            }
+        }
+        ImGui::Dummy(ImVec2(width, height));
+        ImGui::Text("Scale: %.2f ms (frame p99)", scale);
+    }
+
+    inline void drawStatsTable(const FrameProfiler& p) {
+        ImGui::Columns(4, "profilerStats");
+        ImGui::Text("Stage");
+        ImGui::NextColumn();
+        ImGui::Text("min ms");
+        ImGui::NextColumn();
+        ImGui::Text("avg ms");
+        ImGui::NextColumn();
+        ImGui::Text("p99 ms");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (size_t s = 0; s < stageCount; ++s) {
+            Stats stats = p.stats(Stage(s));
+            ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(stageColor(Stage(s))), "%s", stageName(Stage(s)));
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", stats.min);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", stats.avg);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", stats.p99);
+            ImGui::NextColumn();
+        }
+        Stats frame = p.frameStats();
+        ImGui::Separator();
+        ImGui::Text("Frame");
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", frame.min);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", frame.avg);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", frame.p99);
+        ImGui::NextColumn();
+        ImGui::Columns(1);
+    }
+
+    inline void drawRenderStats(const e3d::RenderStats& stats) {
+        ImGui::SetNextWindowSize(ImVec2(260, 190), ImGuiCond_FirstUseEver);
+        if (ImGui::Begin("Render statistics")) {
+            ImGui::Text("Vertices transformed: %llu", (unsigned long long)stats.verticesTransformed);
+            ImGui::Text("Triangles submitted:  %llu", (unsigned long long)stats.trianglesSubmitted);
+            ImGui::Text("Triangles culled:     %llu", (unsigned long long)stats.trianglesCulled);
+            ImGui::Text("Triangles clipped:    %llu", (unsigned long long)stats.trianglesClipped);
+            ImGui::Text("Draw calls:           %llu", (unsigned long long)stats.drawCalls);
+            ImGui::Text("State changes:        %llu", (unsigned long long)stats.stateChanges);
+            ImGui::Text("Pixels written:       %llu", (unsigned long long)stats.pixelsWritten);
+            ImGui::Text("Bytes allocated:      %llu", (unsigned long long)stats.bytesAllocated);
+        }
+        ImGui::End();
+    }
+
+    inline void drawOverlay(FrameProfiler& p) {
+        ImGui::SetNextWindowSize(ImVec2(420, 260), ImGuiCond_FirstUseEver);
+        if (ImGui::Begin("Frame profiler")) {
+            ImGui::Checkbox("Enabled", &p.enabled);
+            drawTimeline(p);
+            drawStatsTable(p);
+        }
+        ImGui::End();
+    }
+
+}
+
+#endif // PROFILER_GUI_H_
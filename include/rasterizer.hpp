@@ -0,0 +1,253 @@
+#ifndef RASTERIZER_H_
+#define RASTERIZER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "engine3d.hpp"
+#include "texture.hpp"
+
+// Software rendering backend: fills depth-tested polygons into a CPU
+// framebuffer, with no window or GL context needed.
+
+namespace e3d {
+
+    class Framebuffer {
+        public:
+            Framebuffer(const unsigned int w, const unsigned int h)
+                : width {w}, height {h}, color(size_t(w) * h), depth(size_t(w) * h) {
+                clear();
+            }
+
+            void clear(const std::uint32_t rgba = packColor(0, 0, 0), const float z = 1) {
+                std::fill(color.begin(), color.end(), rgba);
+                std::fill(depth.begin(), depth.end(), z);
+            }
+
+            // RGBA bytes, row by row, as sf::Image expects them
+            const std::uint8_t* pixels() const {
+                return reinterpret_cast<const std::uint8_t*>(color.data());
+            }
+
+            sf::Image toImage() const {
+                sf::Image image;
+                image.create(width, height, pixels());
+                return image;
+            }
+
+            bool saveToFile(const std::string& filename) const {
+                return toImage().saveToFile(filename);
+            }
+
+            unsigned int width;
+            unsigned int height;
+            std::vector<std::uint32_t> color;
+            std::vector<float> depth;
+    };
+
+    class SoftwareBackend : public Backend {
+        public:
+            explicit SoftwareBackend(Framebuffer& fb) : framebuffer {fb} {}
+
+            sf::Vector2u size() const override {
+                return sf::Vector2u(framebuffer.width, framebuffer.height);
+            }
+
+            void setMaterial(const Material& material) override {
+                color = packColor(material.r, material.g, material.b);
+                tint[0] = material.r / 255.0f;
+                tint[1] = material.g / 255.0f;
+                tint[2] = material.b / 255.0f;
+                texture = material.texture;
+                filter = material.filter;
+            }
+
+            // Fan triangulation of the convex polygon
+            std::uint64_t drawPolygon(const ScreenVertex* vertices, const int count, FrameArena&) override {
+                std::uint64_t pixels = 0;
+                for (int i = 1; i + 1 < count; ++i) {
+                    pixels += fillTriangle(vertices[0], vertices[i], vertices[i + 1]);
+                }
+                return pixels;
+            }
+
+            // Lines are drawn on top, without depth testing
+            std::uint64_t drawLines(const ScreenVertex* vertices, const int count, FrameArena&) override {
+                std::uint64_t pixels = 0;
+                for (int i = 0; i + 1 < count; i += 2) {
+                    pixels += drawLine(vertices[i], vertices[i + 1]);
+                }
+                return pixels;
+            }
+
+        private:
+            Framebuffer& framebuffer;
+            std::uint32_t color = packColor(255, 255, 255);
+            float tint[3] = {1, 1, 1};
+            const Texture* texture = nullptr;
+            Filter filter = Filter::Bilinear;
+
+            static bool plain(const ScreenVertex& v) {
+                const VertexAttributes& a = v.attributes;
+                return a.r == 1 && a.g == 1 && a.b == 1 && a.a == 1;
+            }
+
+            static float edge(const ScreenVertex& a, const ScreenVertex& b, const float x, const float y) {
+                return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+            }
+
+            // Top-left rule, so pixels on an edge shared by two triangles are
+            // filled exactly once
+            static bool topLeft(const ScreenVertex& a, const ScreenVertex& b) {
+                return (a.y == b.y && b.x < a.x) || b.y > a.y;
+            }
+
+            // Edge function rasterization over the triangle's bounding box, with
+            // depth interpolated linearly in screen space and tested 'less'.
+            // Untextured triangles with plain white vertices are filled with
+            // the material color; the rest go through the shaded path.
+            std::uint64_t fillTriangle(ScreenVertex a, ScreenVertex b, ScreenVertex c) {
+                float area = edge(a, b, c.x, c.y);
+                if (area == 0) {
+                    return 0;
+                }
+                if (area < 0) {
+                    std::swap(b, c);
+                    area = -area;
+                }
+                int x0 = std::max(0, int(std::floor(std::min({a.x, b.x, c.x}))));
+                int x1 = std::min(int(framebuffer.width) - 1, int(std::ceil(std::max({a.x, b.x, c.x}))));
+                int y0 = std::max(0, int(std::floor(std::min({a.y, b.y, c.y}))));
+                int y1 = std::min(int(framebuffer.height) - 1, int(std::ceil(std::max({a.y, b.y, c.y}))));
+                float bias0 = topLeft(b, c) ? 0 : -1e-6f;
+                float bias1 = topLeft(c, a) ? 0 : -1e-6f;
+                float bias2 = topLeft(a, b) ? 0 : -1e-6f;
+                if (texture || !plain(a) || !plain(b) || !plain(c)) {
+                    return fillShaded(a, b, c, area, x0, x1, y0, y1, bias0, bias1, bias2);
+                }
+
+                std::uint64_t pixels = 0;
+                for (int y = y0; y <= y1; ++y) {
+                    float py = y + 0.5f;
+                    for (int x = x0; x <= x1; ++x) {
+                        float px = x + 0.5f;
+                        float w0 = edge(b, c, px, py);
+                        float w1 = edge(c, a, px, py);
+                        float w2 = edge(a, b, px, py);
+                        if (w0 + bias0 < 0 || w1 + bias1 < 0 || w2 + bias2 < 0) {
+                            continue;
+                        }
+                        float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+                        size_t i = size_t(y) * framebuffer.width + x;
+                        if (z < framebuffer.depth[i]) {
+                            framebuffer.depth[i] = z;
+                            framebuffer.color[i] = color;
+                            ++pixels;
+                        }
+                    }
+                }
+                return pixels;
+            }
+
+            // Attributes are interpolated perspective-correctly: a/w and 1/w are
+            // linear in screen space, so each pixel divides one by the other.
+            // Texture LOD comes from the analytic screen-space derivatives of
+            // u and v. Texels are modulated by the vertex color and the
+            // material color; pixels whose alpha ends up below one half are
+            // discarded (alpha test) and the rest are written opaque.
+            std::uint64_t fillShaded(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c,
+                                     const float area, const int x0, const int x1, const int y0, const int y1,
+                                     const float bias0, const float bias1, const float bias2) {
+                const VertexAttributes* attr[3] = {&a.attributes, &b.attributes, &c.attributes};
+                const float invW[3] = {a.invW, b.invW, c.invW};
+                // d(barycentric)/dx and /dy of the three weights
+                const float dldx[3] = {(b.y - c.y) / area, (c.y - a.y) / area, (a.y - b.y) / area};
+                const float dldy[3] = {(c.x - b.x) / area, (a.x - c.x) / area, (b.x - a.x) / area};
+                float dWdx = 0, dWdy = 0, dUdx = 0, dUdy = 0, dVdx = 0, dVdy = 0;
+                for (int i = 0; i < 3; ++i) {
+                    dWdx += invW[i] * dldx[i];
+                    dWdy += invW[i] * dldy[i];
+                    dUdx += attr[i]->u * invW[i] * dldx[i];
+                    dUdy += attr[i]->u * invW[i] * dldy[i];
+                    dVdx += attr[i]->v * invW[i] * dldx[i];
+                    dVdy += attr[i]->v * invW[i] * dldy[i];
+                }
+                bool mipmapped = texture && texture->levelCount() > 1;
+
+                std::uint64_t pixels = 0;
+                for (int y = y0; y <= y1; ++y) {
+                    float py = y + 0.5f;
+                    for (int x = x0; x <= x1; ++x) {
+                        float px = x + 0.5f;
+                        float w0 = edge(b, c, px, py);
+                        float w1 = edge(c, a, px, py);
+                        float w2 = edge(a, b, px, py);
+                        if (w0 + bias0 < 0 || w1 + bias1 < 0 || w2 + bias2 < 0) {
+                            continue;
+                        }
+                        float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+                        size_t i = size_t(y) * framebuffer.width + x;
+                        if (z >= framebuffer.depth[i]) {
+                            continue;
+                        }
+                        float l[3] = {w0 / area * invW[0], w1 / area * invW[1], w2 / area * invW[2]};
+                        float W = l[0] + l[1] + l[2];
+                        float rgba[4];
+                        for (int k = 0; k < 4; ++k) {
+                            rgba[k] = (l[0] * (&attr[0]->r)[k] + l[1] * (&attr[1]->r)[k] + l[2] * (&attr[2]->r)[k]) / W;
+                        }
+                        if (texture) {
+                            float U = l[0] * attr[0]->u + l[1] * attr[1]->u + l[2] * attr[2]->u;
+                            float V = l[0] * attr[0]->v + l[1] * attr[1]->v + l[2] * attr[2]->v;
+                            float u = U / W, v = V / W;
+                            float lod = 0;
+                            if (mipmapped) {
+                                float W2 = W * W;
+                                lod = texture->lod((dUdx * W - U * dWdx) / W2, (dVdx * W - V * dWdx) / W2,
+                                                   (dUdy * W - U * dWdy) / W2, (dVdy * W - V * dWdy) / W2);
+                            }
+                            std::uint32_t texel = texture->sample(u, v, lod, filter);
+                            std::uint8_t t[4];
+                            std::memcpy(t, &texel, 4);
+                            for (int k = 0; k < 4; ++k) {
+                                rgba[k] *= t[k] / 255.0f;
+                            }
+                        }
+                        if (rgba[3] < 0.5f) {
+                            continue;
+                        }
+                        framebuffer.depth[i] = z;
+                        framebuffer.color[i] = packColor(channel(rgba[0] * tint[0]), channel(rgba[1] * tint[1]),
+                                                         channel(rgba[2] * tint[2]));
+                        ++pixels;
+                    }
+                }
+                return pixels;
+            }
+
+            static std::uint8_t channel(const float f) {
+                return std::uint8_t(std::min(std::max(f, 0.0f), 1.0f) * 255 + 0.5f);
+            }
+
+            std::uint64_t drawLine(const ScreenVertex& a, const ScreenVertex& b) {
+                int steps = int(std::max(std::abs(b.x - a.x), std::abs(b.y - a.y)));
+                std::uint64_t pixels = 0;
+                for (int s = 0; s <= steps; ++s) {
+                    float t = steps ? float(s) / steps : 0;
+                    int x = int(a.x + t * (b.x - a.x));
+                    int y = int(a.y + t * (b.y - a.y));
+                    if (x >= 0 && y >= 0 && x < int(framebuffer.width) && y < int(framebuffer.height)) {
+                        framebuffer.color[size_t(y) * framebuffer.width + x] = color;
+                        ++pixels;
+                    }
+                }
+                return pixels;
+            }
+    };
+
+}
+
+#endif // RASTERIZER_H_
@@ -0,0 +1,552 @@
+#ifndef RAYTRACER_H_
+#define RAYTRACER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "matrix.hpp"
+#include "engine3d.hpp"
+
+// Offline CPU ray tracer for e3d scenes.
+//
+// Consumes the same Poly/Camera description that Device rasterizes, builds a
+// BVH over the world-space triangles and traces 2x2 ray packets through it.
+// Image tiles are distributed over all cores by a work-stealing scheduler.
+// Runs headless: the result is a plain RGBA buffer that can be saved as PNG.
+
+namespace e3d {
+namespace rt {
+
+    // Single precision vector. Operators are members so they don't hide the
+    // matrix:: operators declared at global scope.
+    struct Vec {
+        float x, y, z;
+        Vec operator+(const Vec& b) const { return {x + b.x, y + b.y, z + b.z}; }
+        Vec operator-(const Vec& b) const { return {x - b.x, y - b.y, z - b.z}; }
+        Vec operator*(const float k) const { return {k * x, k * y, k * z}; }
+    };
+
+    inline float dot(const Vec& a, const Vec& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Vec cross(const Vec& a, const Vec& b) {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+    inline Vec normalized(const Vec& v) { return v * (1 / std::sqrt(dot(v, v))); }
+    inline float axis(const Vec& v, const int i) { return i == 0 ? v.x : (i == 1 ? v.y : v.z); }
+    inline Vec vmin(const Vec& a, const Vec& b) {
+        return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+    }
+    inline Vec vmax(const Vec& a, const Vec& b) {
+        return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+    }
+
+    struct Box {
+        Vec min {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+        Vec max {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+        void grow(const Vec& p) {
+            min = vmin(min, p);
+            max = vmax(max, p);
+        }
+        void grow(const Box& b) {
+            min = vmin(min, b.min);
+            max = vmax(max, b.max);
+        }
+        float area() const {
+            Vec e = max - min;
+            if (e.x < 0) {
+                return 0;
+            }
+            return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+    };
+
+    // World-space triangle, stored in the form Moller-Trumbore wants
+    struct Tri {
+        Vec v0;
+        Vec e1;
+        Vec e2;
+        Vec normal;
+        Vec centroid;
+    };
+
+    struct Ray {
+        Vec origin;
+        Vec dir;
+        Vec invDir;
+        float t;
+        int tri;
+    };
+
+    // Rays traced together through the BVH. A node is visited once for the
+    // whole packet if any of its rays can hit it.
+    struct RayPacket {
+        static constexpr int size = 4;
+        Ray rays[size];
+    };
+
+    struct BVHNode {
+        Box bounds;
+        int first; // first triangle for leaves, left child for interior nodes
+        int count; // 0 for interior nodes
+    };
+
+    class BVH {
+        public:
+            static constexpr int leafSize = 4;
+            static constexpr int bins = 12;
+            // Deeper nodes become leaves whatever their size, which bounds the
+            // build's recursion and the traversal stack even for lopsided splits
+            static constexpr int maxDepth = 48;
+
+            void build(std::vector<Tri>& tris) {
+                triangles = &tris;
+                nodes.clear();
+                indices.resize(tris.size());
+                for (size_t i = 0; i < tris.size(); ++i) {
+                    indices[i] = int(i);
+                }
+                if (tris.empty()) {
+                    return;
+                }
+                nodes.reserve(2 * tris.size());
+                nodes.push_back(BVHNode{});
+                nodes[0].first = 0;
+                nodes[0].count = tris.size();
+                subdivide(0, 0);
+            }
+
+            void intersect(RayPacket& packet) const {
+                if (nodes.empty()) {
+                    return;
+                }
+                // Each level of the path holds at most one postponed sibling
+                int stack[maxDepth + 2];
+                int top = 0;
+                stack[top++] = 0;
+                while (top > 0) {
+                    const BVHNode& node = nodes[stack[--top]];
+                    if (!anyHits(node.bounds, packet)) {
+                        continue;
+                    }
+                    if (node.count > 0) {
+                        for (int i = node.first; i < node.first + node.count; ++i) {
+                            for (Ray& ray : packet.rays) {
+                                intersect(ray, indices[i]);
+                            }
+                        }
+                    }
+                    else {
+                        // Visit the nearer child first, judged by the packet's first ray
+                        int left = node.first;
+                        int right = node.first + 1;
+                        if (distance(nodes[left].bounds, packet.rays[0]) > distance(nodes[right].bounds, packet.rays[0])) {
+                            std::swap(left, right);
+                        }
+                        assert(top + 2 <= maxDepth + 2);
+                        stack[top++] = right;
+                        stack[top++] = left;
+                    }
+                }
+            }
+
+            const Tri& triangle(const int i) const {
+                return (*triangles)[i];
+            }
+
+            size_t size() const {
+                return nodes.size();
+            }
+
+            // Levels from the root to the deepest leaf
+            int depth() const {
+                return nodes.empty() ? 0 : depthBelow(0);
+            }
+
+        private:
+            std::vector<BVHNode> nodes;
+            std::vector<int> indices;
+            std::vector<Tri>* triangles = nullptr;
+
+            const Vec& centroid(const int i) const {
+                return (*triangles)[indices[i]].centroid;
+            }
+
+            int depthBelow(const int n) const {
+                const BVHNode& node = nodes[n];
+                return node.count > 0 ? 1 : 1 + std::max(depthBelow(node.first), depthBelow(node.first + 1));
+            }
+
+            Box triangleBounds(const int i) const {
+                const Tri& t = (*triangles)[indices[i]];
+                Box b;
+                b.grow(t.v0);
+                b.grow(t.v0 + t.e1);
+                b.grow(t.v0 + t.e2);
+                return b;
+            }
+
+            void subdivide(const int n, const int depth) {
+                Box bounds;
+                Box centroids;
+                for (int i = nodes[n].first; i < nodes[n].first + nodes[n].count; ++i) {
+                    bounds.grow(triangleBounds(i));
+                    centroids.grow(centroid(i));
+                }
+                nodes[n].bounds = bounds;
+                if (nodes[n].count <= leafSize || depth >= maxDepth) {
+                    return;
+                }
+
+                // Binned surface area heuristic over the widest centroid axis
+                Vec extent = centroids.max - centroids.min;
+                int a = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+                float lo = axis(centroids.min, a);
+                float width = axis(extent, a);
+                if (width <= 0) {
+                    return;
+                }
+                Box binBounds[bins];
+                int binCount[bins] = {};
+                auto binOf = [&](const int i) {
+                    int b = int(bins * (axis(centroid(i), a) - lo) / width);
+                    return std::min(b, bins - 1);
+                };
+                for (int i = nodes[n].first; i < nodes[n].first + nodes[n].count; ++i) {
+                    int b = binOf(i);
+                    ++binCount[b];
+                    binBounds[b].grow(triangleBounds(i));
+                }
+                float bestCost = std::numeric_limits<float>::max();
+                int bestSplit = -1;
+                for (int split = 1; split < bins; ++split) {
+                    Box left, right;
+                    int leftCount = 0, rightCount = 0;
+                    for (int b = 0; b < split; ++b) {
+                        left.grow(binBounds[b]);
+                        leftCount += binCount[b];
+                    }
+                    for (int b = split; b < bins; ++b) {
+                        right.grow(binBounds[b]);
+                        rightCount += binCount[b];
+                    }
+                    float cost = left.area() * leftCount + right.area() * rightCount;
+                    if (leftCount > 0 && rightCount > 0 && cost < bestCost) {
+                        bestCost = cost;
+                        bestSplit = split;
+                    }
+                }
+                if (bestSplit < 0 || bestCost >= bounds.area() * nodes[n].count) {
+                    return;
+                }
+
+                int first = nodes[n].first;
+                int last = first + nodes[n].count;
+                int mid = std::partition(indices.begin() + first, indices.begin() + last,
+                                         [&](const int t) {
+                                             float c = axis((*triangles)[t].centroid, a);
+                                             return std::min(int(bins * (c - lo) / width), bins - 1) < bestSplit;
+                                         }) - indices.begin();
+
+                int left = nodes.size();
+                nodes.push_back(BVHNode{Box{}, first, mid - first});
+                nodes.push_back(BVHNode{Box{}, mid, last - mid});
+                nodes[n].first = left;
+                nodes[n].count = 0;
+                subdivide(left, depth + 1);
+                subdivide(left + 1, depth + 1);
+            }
+
+            // Entry distance of 'ray' into 'box', or infinity if it misses
+            static float distance(const Box& box, const Ray& ray) {
+                float tx1 = (box.min.x - ray.origin.x) * ray.invDir.x;
+                float tx2 = (box.max.x - ray.origin.x) * ray.invDir.x;
+                float tmin = std::min(tx1, tx2);
+                float tmax = std::max(tx1, tx2);
+                float ty1 = (box.min.y - ray.origin.y) * ray.invDir.y;
+                float ty2 = (box.max.y - ray.origin.y) * ray.invDir.y;
+                tmin = std::max(tmin, std::min(ty1, ty2));
+                tmax = std::min(tmax, std::max(ty1, ty2));
+                float tz1 = (box.min.z - ray.origin.z) * ray.invDir.z;
+                float tz2 = (box.max.z - ray.origin.z) * ray.invDir.z;
+                tmin = std::max(tmin, std::min(tz1, tz2));
+                tmax = std::min(tmax, std::max(tz1, tz2));
+                if (tmax >= tmin && tmin < ray.t && tmax > 0) {
+                    return tmin;
+                }
+                return std::numeric_limits<float>::infinity();
+            }
+
+            static bool anyHits(const Box& box, const RayPacket& packet) {
+                for (const Ray& ray : packet.rays) {
+                    if (distance(box, ray) != std::numeric_limits<float>::infinity()) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Moller-Trumbore, double sided
+            void intersect(Ray& ray, const int i) const {
+                const Tri& tri = (*triangles)[i];
+                Vec p = cross(ray.dir, tri.e2);
+                float det = dot(tri.e1, p);
+                if (std::abs(det) < 1e-9f) {
+                    return;
+                }
+                float invDet = 1 / det;
+                Vec s = ray.origin - tri.v0;
+                float u = dot(s, p) * invDet;
+                if (u < 0 || u > 1) {
+                    return;
+                }
+                Vec q = cross(s, tri.e1);
+                float v = dot(ray.dir, q) * invDet;
+                if (v < 0 || u + v > 1) {
+                    return;
+                }
+                float t = dot(tri.e2, q) * invDet;
+                if (t > 0 && t < ray.t) {
+                    ray.t = t;
+                    ray.tri = i;
+                }
+            }
+    };
+
+    struct Tile {
+        int x0, y0, x1, y1;
+    };
+
+    // Work-stealing tile queues: each worker pops from the back of its own
+    // queue and, once that is empty, steals from the front of the others'.
+    class TileScheduler {
+        public:
+            explicit TileScheduler(const int workers) {
+                for (int i = 0; i < workers; ++i) {
+                    queues.push_back(std::make_unique<Queue>());
+                }
+            }
+
+            void push(const int worker, const Tile& tile) {
+                Queue& q = *queues[worker % queues.size()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.tiles.push_back(tile);
+            }
+
+            bool next(const int worker, Tile& tile) {
+                {
+                    Queue& own = *queues[worker];
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (!own.tiles.empty()) {
+                        tile = own.tiles.back();
+                        own.tiles.pop_back();
+                        return true;
+                    }
+                }
+                for (size_t i = 1; i < queues.size(); ++i) {
+                    Queue& victim = *queues[(worker + i) % queues.size()];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.tiles.empty()) {
+                        tile = victim.tiles.front();
+                        victim.tiles.pop_front();
+                        ++stolen;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            std::atomic<int> stolen {0};
+
+        private:
+            struct Queue {
+                std::mutex mutex;
+                std::deque<Tile> tiles;
+            };
+            std::vector<std::unique_ptr<Queue>> queues;
+    };
+
+    struct RenderResult {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        std::vector<std::uint8_t> pixels; // RGBA
+        std::uint64_t rays = 0;
+        double seconds = 0;
+        int tilesStolen = 0;
+
+        double raysPerSecond() const {
+            return seconds > 0 ? rays / seconds : 0;
+        }
+
+        bool saveToFile(const std::string& filename) const {
+            sf::Image image;
+            image.create(width, height, pixels.data());
+            return image.saveToFile(filename);
+        }
+    };
+
+    class Tracer {
+        public:
+            static constexpr int tileSize = 16;
+
+            Tracer(const std::vector<const Poly*>& scene, const Camera& c) : camera {c} {
+                for (const Poly* poly : scene) {
+                    for (const Triangle& t : poly->triangles) {
+                        addTriangle(transform(t.a, poly->objectToWorldMatrix),
+                                    transform(t.b, poly->objectToWorldMatrix),
+                                    transform(t.c, poly->objectToWorldMatrix));
+                    }
+                }
+                bvh.build(triangles);
+            }
+
+            // The BVH points into 'triangles'
+            Tracer(const Tracer&) = delete;
+            Tracer& operator=(const Tracer&) = delete;
+
+            RenderResult render(const unsigned int width, const unsigned int height,
+                                int threads = std::thread::hardware_concurrency()) const {
+                threads = std::max(threads, 1);
+                RenderResult result;
+                result.width = width;
+                result.height = height;
+                result.pixels.resize(size_t(width) * height * 4);
+
+                TileScheduler scheduler(threads);
+                int n = 0;
+                for (unsigned int y = 0; y < height; y += tileSize) {
+                    for (unsigned int x = 0; x < width; x += tileSize) {
+                        scheduler.push(n++, Tile{int(x), int(y),
+                                                 int(std::min(x + tileSize, width)),
+                                                 int(std::min(y + tileSize, height))});
+                    }
+                }
+
+                std::atomic<std::uint64_t> rays {0};
+                auto start = std::chrono::steady_clock::now();
+                auto worker = [&](const int id) {
+                    std::uint64_t traced = 0;
+                    Tile tile;
+                    while (scheduler.next(id, tile)) {
+                        traced += renderTile(tile, width, height, result.pixels);
+                    }
+                    rays += traced;
+                };
+                std::vector<std::thread> pool;
+                for (int i = 1; i < threads; ++i) {
+                    pool.emplace_back(worker, i);
+                }
+                worker(0);
+                for (auto& t : pool) {
+                    t.join();
+                }
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                result.rays = rays;
+                result.tilesStolen = scheduler.stolen;
+                return result;
+            }
+
+            // Primary ray through the center of pixel (px, py)
+            Ray primaryRay(const float px, const float py, const unsigned int width, const unsigned int height) const {
+                float x = 2 * px / width - 1;
+                float y = 1 - 2 * py / height;
+                matrix::Vector4 d = matrix::Vector4{x / projection[0][0], y / projection[1][1], -1, 0} * cameraToWorld;
+                Ray ray;
+                ray.origin = origin;
+                ray.dir = normalized(Vec{float(d[0]), float(d[1]), float(d[2])});
+                ray.invDir = Vec{1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z};
+                ray.t = camera.far;
+                ray.tri = -1;
+                return ray;
+            }
+
+            void trace(RayPacket& packet) const {
+                bvh.intersect(packet);
+            }
+
+            size_t triangleCount() const {
+                return triangles.size();
+            }
+
+        private:
+            Camera camera;
+            std::vector<Tri> triangles;
+            BVH bvh;
+            // Device maps points into camera space with camera.cameraToWorldMatrix,
+            // so rays are taken back to world space with its inverse.
+            matrix::Matrix4x4 cameraToWorld = inverse(camera.cameraToWorldMatrix);
+            matrix::Matrix4x4 projection = camera.projectionMatrix();
+            Vec origin = toVec(matrix::Vector4{0, 0, 0, 1} * cameraToWorld);
+
+            static Vec toVec(const matrix::Row<4>& v) {
+                return Vec{float(v[0]), float(v[1]), float(v[2])};
+            }
+
+            static Vec toVec(const matrix::Vector3& v) {
+                return Vec{float(v[0]), float(v[1]), float(v[2])};
+            }
+
+            void addTriangle(const matrix::Vector3& a, const matrix::Vector3& b, const matrix::Vector3& c) {
+                Tri t;
+                t.v0 = toVec(a);
+                t.e1 = toVec(b) - t.v0;
+                t.e2 = toVec(c) - t.v0;
+                Vec n = cross(t.e1, t.e2);
+                if (dot(n, n) == 0) {
+                    return; // degenerate
+                }
+                t.normal = normalized(n);
+                t.centroid = (t.v0 + t.v0 + t.v0 + t.e1 + t.e2) * (1.0f / 3);
+                triangles.push_back(t);
+            }
+
+            // Headlight Lambert shading, so the still reads like the wireframe view
+            std::uint8_t shade(const Ray& ray) const {
+                if (ray.tri < 0) {
+                    return 0;
+                }
+                float lambert = std::abs(dot(triangles[ray.tri].normal, ray.dir));
+                return std::uint8_t(255 * (0.1f + 0.9f * lambert));
+            }
+
+            std::uint64_t renderTile(const Tile& tile, const unsigned int width, const unsigned int height,
+                                     std::vector<std::uint8_t>& pixels) const {
+                std::uint64_t traced = 0;
+                for (int y = tile.y0; y < tile.y1; y += 2) {
+                    for (int x = tile.x0; x < tile.x1; x += 2) {
+                        RayPacket packet;
+                        for (int i = 0; i < RayPacket::size; ++i) {
+                            packet.rays[i] = primaryRay(x + i % 2 + 0.5f, y + i / 2 + 0.5f, width, height);
+                        }
+                        trace(packet);
+                        for (int i = 0; i < RayPacket::size; ++i) {
+                            int px = x + i % 2;
+                            int py = y + i / 2;
+                            if (px >= tile.x1 || py >= tile.y1) {
+                                continue;
+                            }
+                            std::uint8_t v = shade(packet.rays[i]);
+                            size_t p = (size_t(py) * width + px) * 4;
+                            pixels[p] = v;
+                            pixels[p + 1] = v;
+                            pixels[p + 2] = v;
+                            pixels[p + 3] = 255;
+                            ++traced;
+                        }
+                    }
+                }
+                return traced;
+            }
+    };
+
+}
+}
+
+#endif // RAYTRACER_H_
@@ -0,0 +1,109 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "engine3d.hpp"
+#include "jobs.hpp"
+
+namespace e3d {
+
+    // Radius of the sphere around the object's origin that holds all its vertices
+    inline double boundingRadius(const Poly& poly) {
+        double r2 = 0;
+        for (const Triangle& t : poly.triangles) {
+            r2 = std::max({r2, t.a * t.a, t.b * t.b, t.c * t.c});
+        }
+        return std::sqrt(r2);
+    }
+
+    // True if a sphere given in camera space can't be seen by 'camera'
+    inline bool sphereOutsideFrustum(const matrix::Vector3& center, const double radius, const Camera& camera) {
+        double depth = -center[2];
+        if (depth + radius < camera.near || depth - radius > camera.far) {
+            return true;
+        }
+        // Side planes pass through the eye with slope 1/tan(fov/2); the sphere is
+        // outside if it lies entirely beyond one of them
+        double t = std::tan(camera.fov * 3.141592 / 360.0);
+        double scale = std::sqrt(1 + t * t);
+        return std::abs(center[0]) - t * depth > radius * scale ||
+               std::abs(center[1]) - t * depth > radius * scale;
+    }
+
+    // Records draw packets for a scene on several threads at once
+    //
+    // Each slice of the scene is a job on the engine's job system and owns a
+    // frame arena and a command buffer, culling objects outside the view
+    // frustum, so nothing mutable is shared while recording. The calling
+    // thread then merges the slices' buffers, in slice order, into the
+    // command buffer that gets sorted and submitted.
+    class ParallelRecorder {
+        public:
+            explicit ParallelRecorder(const int threads = std::max(1u, std::thread::hardware_concurrency()),
+                                      jobs::JobSystem& system = jobs::scheduler())
+                : jobSystem {system} {
+                for (int i = 0; i < std::max(threads, 1); ++i) {
+                    workers.push_back(std::make_unique<Worker>());
+                }
+            }
+
+            void record(const std::vector<const Poly*>& scene, const Camera& camera, CommandBuffer& out) {
+                E3D_TRACE_SCOPE("ParallelRecorder::record");
+                size_t slices = std::min(workers.size(), std::max<size_t>(scene.size(), 1));
+                size_t sliceSize = (scene.size() + slices - 1) / slices;
+                jobSystem.parallelFor(0, slices, 1, [&](const size_t first, const size_t last) {
+                    for (size_t i = first; i < last; ++i) {
+                        recordSlice(*workers[i], scene, std::min(i * sliceSize, scene.size()),
+                                    std::min((i + 1) * sliceSize, scene.size()), camera);
+                    }
+                });
+                culledObjects = 0;
+                for (size_t i = 0; i < slices; ++i) {
+                    out.append(workers[i]->commands);
+                    culledObjects += workers[i]->culled;
+                }
+            }
+
+            size_t threadCount() const {
+                return workers.size();
+            }
+
+            // Objects skipped by the last record() call
+            size_t culledObjects = 0;
+
+        private:
+            jobs::JobSystem& jobSystem;
+
+            struct Worker {
+                FrameArena arena {64 * 1024};
+                CommandBuffer commands {arena};
+                size_t culled = 0;
+            };
+            std::vector<std::unique_ptr<Worker>> workers;
+
+            static void recordSlice(Worker& worker, const std::vector<const Poly*>& scene,
+                                    const size_t first, const size_t last, const Camera& camera) {
+                E3D_TRACE_SCOPE("ParallelRecorder::recordSlice");
+                worker.arena.reset();
+                worker.commands.clear();
+                worker.culled = 0;
+                for (size_t i = first; i < last; ++i) {
+                    const Poly& poly = *scene[i];
+                    matrix::Vector3 center = transform(matrix::Vector3{0, 0, 0},
+                                                       poly.objectToWorldMatrix * camera.cameraToWorldMatrix);
+                    if (sphereOutsideFrustum(center, boundingRadius(poly), camera)) {
+                        ++worker.culled;
+                        continue;
+                    }
+                    poly.record(worker.commands, camera);
+                }
+            }
+    };
+
+}
+
+#endif // RECORDER_H_
@@ -0,0 +1,134 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <SFML/Window/Event.hpp>
+
+// Recorded input for deterministic replays
+//
+// An event log holds the window events polled on every frame. It is saved
+// as text, one line per event under a "frame" line per frame:
+//
+//     # e3d event log 1
+//     frame
+//     key-pressed 71 0 0 0 0
+//     frame
+//     closed
+//
+// Key events carry the key code and the alt, control, shift and system
+// flags. Only the events that drive the scene (window close and keys) are
+// kept; mouse and text events only matter to the GUI.
+
+namespace e3d {
+
+    class EventLog {
+        public:
+            void beginFrame() {
+                frames.emplace_back();
+            }
+
+            void add(const sf::Event& event) {
+                if (event.type != sf::Event::Closed && event.type != sf::Event::KeyPressed &&
+                    event.type != sf::Event::KeyReleased) {
+                    return;
+                }
+                if (frames.empty()) {
+                    beginFrame();
+                }
+                frames.back().push_back(event);
+            }
+
+            size_t frameCount() const {
+                return frames.size();
+            }
+
+            const std::vector<sf::Event>& frame(const size_t i) const {
+                return frames[i];
+            }
+
+            void write(std::ostream& out) const {
+                out << "# e3d event log 1\n";
+                for (const auto& events : frames) {
+                    out << "frame\n";
+                    for (const sf::Event& e : events) {
+                        if (e.type == sf::Event::Closed) {
+                            out << "closed\n";
+                        }
+                        else {
+                            out << (e.type == sf::Event::KeyPressed ? "key-pressed " : "key-released ")
+                                << int(e.key.code) << " " << e.key.alt << " " << e.key.control << " "
+                                << e.key.shift << " " << e.key.system << "\n";
+                        }
+                    }
+                }
+            }
+
+            bool save(const std::string& filename) const {
+                std::ofstream out(filename);
+                if (!out) {
+                    return false;
+                }
+                write(out);
+                return bool(out);
+            }
+
+            // Replaces the log with the one in 'in'; false on a malformed line
+            bool read(std::istream& in) {
+                frames.clear();
+                std::string line;
+                while (std::getline(in, line)) {
+                    std::istringstream fields(line);
+                    std::string kind;
+                    if (!(fields >> kind) || kind[0] == '#') {
+                        continue;
+                    }
+                    if (kind == "frame") {
+                        beginFrame();
+                        continue;
+                    }
+                    sf::Event e {};
+                    if (kind == "closed") {
+                        e.type = sf::Event::Closed;
+                    }
+                    else if (kind == "key-pressed" || kind == "key-released") {
+                        int code;
+                        if (!(fields >> code >> e.key.alt >> e.key.control >> e.key.shift >> e.key.system)) {
+                            return false;
+                        }
+                        e.type = kind == "key-pressed" ? sf::Event::KeyPressed : sf::Event::KeyReleased;
+                        e.key.code = sf::Keyboard::Key(code);
+                    }
+                    else {
+                        return false;
+                    }
+                    add(e);
+                }
+                return true;
+            }
+
+            bool load(const std::string& filename) {
+                std::ifstream in(filename);
+                return in && read(in);
+            }
+
+        private:
+            std::vector<std::vector<sf::Event>> frames;
+    };
+
+    // 64-bit FNV-1a, to compare rendered frames across runs
+    inline std::uint64_t hashBytes(const void* data, const size_t size,
+                                   std::uint64_t hash = 14695981039346656037ull) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+}
+
+#endif // REPLAY_H_
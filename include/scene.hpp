@@ -0,0 +1,82 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include "engine3d.hpp"
+#include "timestep.hpp"
+
+namespace e3d {
+
+    // The demo scene: a cube spinning about its vertical axis, watched by a
+    // keyboard-driven camera. The game and the headless replay runner both
+    // drive it, so a replayed event log produces the same frames.
+    class DemoScene {
+        public:
+            DemoScene() : cube {makeCube()} {
+                cube.move(0, 0, 1);
+            }
+
+            static Camera makeCamera() {
+                Camera camera(1, 10, 0.01f, 100.0f, 89.0f);
+                camera.setPosition(0, 0, -5);
+                return camera;
+            }
+
+            // Applies one input event to the camera; false if it asks to quit
+            bool handleEvent(const sf::Event& event, Camera& camera) const {
+                if (event.type == sf::Event::Closed) {
+                    return false;
+                }
+                if (event.type == sf::Event::KeyPressed) {
+                    switch (event.key.code) {
+                        case sf::Keyboard::Q:
+                            return false;
+                        case sf::Keyboard::Left:
+                            camera.move(-0.1, 0, 0);
+                            break;
+                        case sf::Keyboard::Right:
+                            camera.move(0.1, 0, 0);
+                            break;
+                        case sf::Keyboard::Up:
+                            camera.move(0, 0, -0.1);
+                            break;
+                        case sf::Keyboard::Down:
+                            camera.move(0, 0, 0.1);
+                            break;
+                        case sf::Keyboard::A:
+                            camera.rotate(0, 0, -0.01);
+                            break;
+                        case sf::Keyboard::D:
+                            camera.rotate(0, 0, 0.01);
+                            break;
+                        case sf::Keyboard::W:
+                            camera.rotate(-0.01, 0, 0);
+                            break;
+                        case sf::Keyboard::S:
+                            camera.rotate(0.01, 0, 0);
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                return true;
+            }
+
+            // One fixed simulation step
+            void step(const double seconds) {
+                previousRotation = rotation;
+                rotation += seconds * 0.2;
+            }
+
+            // Poses 'target' (the cube or a copy of it) between the last two steps
+            void pose(Poly& target, const double alpha) const {
+                target.setRotation(0, interpolate(previousRotation, rotation, alpha), 0);
+            }
+
+            Poly cube;
+            double rotation = 0.0;
+            double previousRotation = 0.0;
+    };
+
+}
+
+#endif // SCENE_H_
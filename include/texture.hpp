@@ -0,0 +1,196 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include "basix.hpp"
+
+// Textures for the software rasterizer
+
+namespace e3d {
+
+    // Packs a color so its bytes are in RGBA order in memory
+    inline std::uint32_t packColor(const std::uint8_t r, const std::uint8_t g, const std::uint8_t b,
+                                   const std::uint8_t a = 255) {
+        const std::uint8_t bytes[4] = {r, g, b, a};
+        std::uint32_t color;
+        std::memcpy(&color, bytes, sizeof(color));
+        return color;
+    }
+
+    enum class Filter {
+        Nearest,
+        Bilinear
+    };
+
+    // RGBA texture with a full mip chain, sampled with repeat wrapping
+    //
+    // Every level is stored in 4x4 texel tiles, each tile one 64 byte cache
+    // line, instead of row by row. Texels that are close in 2D, like the
+    // footprint of a bilinear sample or the texels of neighbouring pixels,
+    // then share cache lines whatever the direction a triangle is walked in.
+    // Each level halves the previous one with a 2x2 box filter, down to 1x1
+    // (basix::build_mip_chain).
+    //
+    // It can be loaded through a Resource_holder like sf::Texture, or share
+    // the chain already built for a texture in texture_holder:
+    //
+    //     Resource_holder<e3d::Texture, Identifier> textures;
+    //     textures.load("bricks", "bricks.png");
+    //     e3d::Texture bricks;
+    //     bricks.loadFromMipmaps(texture_holder.get("bricks").mip_levels());
+    class Texture {
+        public:
+            Texture() = default;
+
+            explicit Texture(const sf::Image& image) {
+                loadFromImage(image);
+            }
+
+            bool loadFromImage(const sf::Image& image) {
+                sf::Vector2u size = image.getSize();
+                if (size.x == 0 || size.y == 0) {
+                    return false;
+                }
+                create(size.x, size.y, image.getPixelsPtr());
+                return true;
+            }
+
+            bool loadFromFile(const std::string& filename) {
+                sf::Image image;
+                return image.loadFromFile(filename) && loadFromImage(image);
+            }
+
+            // Reads an SFML texture back from the GPU
+            bool loadFromTexture(const sf::Texture& texture) {
+                return loadFromImage(texture.copyToImage());
+            }
+
+            // 'rgba' holds width * height texels, row by row, 4 bytes each
+            void create(const unsigned int width, const unsigned int height, const std::uint8_t* rgba) {
+                sf::Image image;
+                image.create(width, height, rgba);
+                loadFromMipmaps(basix::build_mip_chain(image));
+            }
+
+            // Takes a ready-made chain, each level half the size of the one before
+            bool loadFromMipmaps(const std::vector<sf::Image>& chain) {
+                if (chain.empty() || chain[0].getSize().x == 0 || chain[0].getSize().y == 0) {
+                    return false;
+                }
+                levels.clear();
+                texels.clear();
+                for (const sf::Image& image : chain) {
+                    addLevel(image.getSize().x, image.getSize().y, image.getPixelsPtr());
+                }
+                return true;
+            }
+
+            int levelCount() const {
+                return levels.size();
+            }
+
+            unsigned int width(const int level = 0) const {
+                return levels[level].width;
+            }
+
+            unsigned int height(const int level = 0) const {
+                return levels[level].height;
+            }
+
+            // Texel of 'level' at integer coordinates, wrapped into the texture
+            std::uint32_t texel(const int level, const int x, const int y) const {
+                const Level& l = levels[level];
+                return fetch(l, wrap(x, l.width), wrap(y, l.height));
+            }
+
+            // Mip level for a pixel whose texture coordinates change by
+            // (dudx, dvdx) and (dudy, dvdy) between it and its neighbours
+            float lod(const float dudx, const float dvdx, const float dudy, const float dvdy) const {
+                float w = levels[0].width, h = levels[0].height;
+                float x = (dudx * w) * (dudx * w) + (dvdx * h) * (dvdx * h);
+                float y = (dudy * w) * (dudy * w) + (dvdy * h) * (dvdy * h);
+                // log2 of the longer footprint axis
+                return 0.5f * std::log2(std::max({x, y, 1e-12f}));
+            }
+
+            // Texture coordinates in [0, 1) cover the texture once; the level
+            // of detail picks the nearest mip level
+            std::uint32_t sample(const float u, const float v, const float lod, const Filter filter) const {
+                int level = std::min(std::max(int(lod + 0.5f), 0), levelCount() - 1);
+                const Level& l = levels[level];
+                if (filter == Filter::Nearest) {
+                    return fetch(l, wrap(int(std::floor(u * l.width)), l.width),
+                                    wrap(int(std::floor(v * l.height)), l.height));
+                }
+                float x = u * l.width - 0.5f;
+                float y = v * l.height - 0.5f;
+                float fx = std::floor(x), fy = std::floor(y);
+                int x0 = wrap(int(fx), l.width), x1 = wrap(int(fx) + 1, l.width);
+                int y0 = wrap(int(fy), l.height), y1 = wrap(int(fy) + 1, l.height);
+                // 8-bit fixed point weights
+                unsigned int wx = unsigned((x - fx) * 256), wy = unsigned((y - fy) * 256);
+                return blend(blend(fetch(l, x0, y0), fetch(l, x1, y0), wx),
+                             blend(fetch(l, x0, y1), fetch(l, x1, y1), wx), wy);
+            }
+
+        private:
+            static constexpr unsigned int tileSize = 4;
+
+            struct Level {
+                unsigned int width;
+                unsigned int height;
+                unsigned int tilesPerRow;
+                size_t offset;  // first texel in 'texels'
+            };
+
+            std::vector<Level> levels;
+            std::vector<std::uint32_t> texels;
+
+            static int wrap(const int i, const unsigned int n) {
+                int m = i % int(n);
+                return m < 0 ? m + n : m;
+            }
+
+            std::uint32_t fetch(const Level& l, const unsigned int x, const unsigned int y) const {
+                size_t tile = size_t(y / tileSize) * l.tilesPerRow + x / tileSize;
+                return texels[l.offset + tile * tileSize * tileSize + (y % tileSize) * tileSize + x % tileSize];
+            }
+
+            void addLevel(const unsigned int w, const unsigned int h, const std::uint8_t* rgba) {
+                Level l {w, h, (w + tileSize - 1) / tileSize, texels.size()};
+                unsigned int tileRows = (h + tileSize - 1) / tileSize;
+                texels.resize(texels.size() + size_t(l.tilesPerRow) * tileRows * tileSize * tileSize);
+                for (unsigned int y = 0; y < h; ++y) {
+                    for (unsigned int x = 0; x < w; ++x) {
+                        size_t tile = size_t(y / tileSize) * l.tilesPerRow + x / tileSize;
+                        std::memcpy(&texels[l.offset + tile * tileSize * tileSize + (y % tileSize) * tileSize + x % tileSize],
+                                    rgba + (size_t(y) * w + x) * 4, 4);
+                    }
+                }
+                levels.push_back(l);
+            }
+
+            // a + (b - a) * weight / 256, per channel
+            static std::uint32_t blend(const std::uint32_t a, const std::uint32_t b, const unsigned int weight) {
+                std::uint8_t ca[4], cb[4], out[4];
+                std::memcpy(ca, &a, 4);
+                std::memcpy(cb, &b, 4);
+                for (int c = 0; c < 4; ++c) {
+                    out[c] = std::uint8_t((ca[c] * (256 - weight) + cb[c] * weight) >> 8);
+                }
+                std::uint32_t result;
+                std::memcpy(&result, out, 4);
+                return result;
+            }
+    };
+
+}
+
+#endif // TEXTURE_H_
@@ -0,0 +1,78 @@
+#ifndef TIMESTEP_H_
+#define TIMESTEP_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace e3d {
+
+    // Fixed-step simulation clock
+    //
+    // Real frame time is accumulated and handed out as a whole number of
+    // fixed steps, so the simulation behaves the same at any frame rate. The
+    // time left over is exposed as alpha(), the fraction of a step to
+    // interpolate by when rendering between the last two simulated states.
+    // A frame never runs more than 'maxSteps' steps: after a long stall the
+    // excess time is dropped instead of spiralling into ever longer frames.
+    //
+    //     for (int i = timestep.advance(seconds); i > 0; --i) {
+    //         previous = current;
+    //         current = simulate(current, timestep.step());
+    //     }
+    //     render(interpolate(previous, current, timestep.alpha()));
+    class FixedTimestep {
+        public:
+            explicit FixedTimestep(const double hz = 60, const int maxSteps = 5)
+                : stepSeconds {1 / hz}, maxSteps {std::max(maxSteps, 1)} {}
+
+            // Number of steps to simulate for 'seconds' of real time
+            int advance(const double seconds) {
+                accumulator += std::max(seconds, 0.0);
+                int steps = int(accumulator / stepSeconds);
+                if (steps > maxSteps) {
+                    dropped += steps - maxSteps;
+                    steps = maxSteps;
+                    accumulator = stepSeconds * steps + std::fmod(accumulator, stepSeconds);
+                }
+                accumulator -= stepSeconds * steps;
+                total += steps;
+                return steps;
+            }
+
+            // Seconds per step
+            double step() const {
+                return stepSeconds;
+            }
+
+            // Progress from the last simulated state towards the next one, in [0, 1)
+            double alpha() const {
+                return std::min(accumulator / stepSeconds, 1.0);
+            }
+
+            std::uint64_t totalSteps() const {
+                return total;
+            }
+
+            // Steps skipped by the catch-up cap
+            std::uint64_t droppedSteps() const {
+                return dropped;
+            }
+
+        private:
+            double stepSeconds;
+            int maxSteps;
+            double accumulator = 0;
+            std::uint64_t total = 0;
+            std::uint64_t dropped = 0;
+    };
+
+    // Linear interpolation, for anything with scalar products and sums
+    template <typename T>
+    T interpolate(const T& a, const T& b, const double alpha) {
+        return (1 - alpha) * a + alpha * b;
+    }
+
+}
+
+#endif // TIMESTEP_H_
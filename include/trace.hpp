@@ -0,0 +1,230 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Chrome Trace Event recorder
+//
+// Scoped markers record complete ("X") events into per-thread buffers. Only
+// the owning thread writes to a buffer: it appends to fixed-size chunks and
+// publishes the event count, which size(), clear() and write() read without
+// ever blocking the recording threads. The whole recording can be written as
+// Chrome Trace Event JSON, which loads in chrome://tracing and ui.perfetto.dev.
+//
+// The markers are compiled in only when E3D_TRACE is defined (CMake option
+// E3D_TRACE); otherwise E3D_TRACE_SCOPE and friends expand to nothing.
+//
+//     E3D_TRACE_SCOPE("Device::draw");
+
+namespace trace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name;
+        Clock::time_point start;
+        Clock::duration duration;
+    };
+
+    class Recorder {
+        public:
+            static Recorder& instance() {
+                static Recorder recorder;
+                return recorder;
+            }
+
+            void record(const char* name, const Clock::time_point start, const Clock::time_point end) {
+                ThreadBuffer& buffer = local();
+                if (buffer.tailSize == Chunk::capacity) {
+                    Chunk* chunk = new Chunk;
+                    buffer.tail->next.store(chunk, std::memory_order_release);
+                    buffer.tail = chunk;
+                    buffer.tailSize = 0;
+                }
+                buffer.tail->events[buffer.tailSize++] = Event{name, start, end - start};
+                buffer.recorded.store(buffer.recorded.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            void setThreadName(const std::string& name) {
+                ThreadBuffer& buffer = local();
+                std::lock_guard<std::mutex> lock(buffer.nameMutex);
+                buffer.name = name;
+            }
+
+            size_t size() {
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t n = 0;
+                for (auto& buffer : buffers) {
+                    n += buffer->recorded.load(std::memory_order_acquire) - buffer->cleared;
+                }
+                return n;
+            }
+
+            // Drops the events recorded so far and frees every chunk the
+            // owning thread has already moved past
+            void clear() {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& buffer : buffers) {
+                    buffer->cleared = buffer->recorded.load(std::memory_order_acquire);
+                    Chunk* next;
+                    while (buffer->headStart + Chunk::capacity <= buffer->cleared
+                           && (next = buffer->head->next.load(std::memory_order_acquire))) {
+                        delete buffer->head;
+                        buffer->head = next;
+                        buffer->headStart += Chunk::capacity;
+                    }
+                }
+            }
+
+            void write(std::ostream& out) {
+                std::lock_guard<std::mutex> lock(mutex);
+                out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+                bool first = true;
+                for (auto& buffer : buffers) {
+                    std::string name;
+                    {
+                        std::lock_guard<std::mutex> nameLock(buffer->nameMutex);
+                        name = buffer->name;
+                    }
+                    if (!name.empty()) {
+                        out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+                            << buffer->tid << ",\"args\":{\"name\":\"" << escape(name) << "\"}}";
+                        first = false;
+                    }
+                    size_t end = buffer->recorded.load(std::memory_order_acquire);
+                    Chunk* chunk = buffer->head;
+                    size_t chunkStart = buffer->headStart;
+                    for (size_t i = buffer->cleared; i < end; ++i) {
+                        if (i == chunkStart + Chunk::capacity) {
+                            chunk = chunk->next.load(std::memory_order_acquire);
+                            chunkStart += Chunk::capacity;
+                        }
+                        const Event& e = chunk->events[i - chunkStart];
+                        out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":\"" << escape(e.name)
+                            << "\",\"pid\":1,\"tid\":" << buffer->tid
+                            << ",\"ts\":" << micros(e.start - epoch)
+                            << ",\"dur\":" << micros(e.duration) << "}";
+                        first = false;
+                    }
+                }
+                out << "\n]}\n";
+            }
+
+            bool write(const std::string& filename) {
+                std::ofstream out(filename);
+                if (!out) {
+                    return false;
+                }
+                write(out);
+                return bool(out);
+            }
+
+        private:
+            struct Chunk {
+                static constexpr size_t capacity = 4096;
+                Event events[capacity];
+                std::atomic<Chunk*> next {nullptr};
+            };
+
+            struct ThreadBuffer {
+                std::uint32_t tid;
+                std::mutex nameMutex;
+                std::string name;
+                // Written only by the owning thread; 'recorded' publishes the
+                // events to the readers
+                Chunk* tail;
+                size_t tailSize = 0;
+                std::atomic<size_t> recorded {0};
+                // Read side, guarded by Recorder::mutex; 'head' holds event
+                // number 'headStart' and everything before 'cleared' is gone
+                Chunk* head;
+                size_t headStart = 0;
+                size_t cleared = 0;
+
+                ThreadBuffer() : tail {new Chunk}, head {tail} {}
+                ~ThreadBuffer() {
+                    while (head) {
+                        Chunk* next = head->next.load(std::memory_order_relaxed);
+                        delete head;
+                        head = next;
+                    }
+                }
+                ThreadBuffer(const ThreadBuffer&) = delete;
+                ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+            };
+
+            std::mutex mutex;
+            std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+            Clock::time_point epoch = Clock::now();
+
+            Recorder() = default;
+
+            // Each thread registers its buffer once and then records into it
+            // without touching the shared list
+            ThreadBuffer& local() {
+                thread_local ThreadBuffer* buffer = nullptr;
+                if (!buffer) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    buffers.push_back(std::make_unique<ThreadBuffer>());
+                    buffer = buffers.back().get();
+                    buffer->tid = buffers.size();
+                }
+                return *buffer;
+            }
+
+            static std::string micros(const Clock::duration d) {
+                std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+                std::string fraction = std::to_string(ns % 1000);
+                return std::to_string(ns / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction;
+            }
+
+            static std::string escape(const std::string& s) {
+                std::string result;
+                for (char c : s) {
+                    if (c == '"' || c == '\\') {
+                        result += '\\';
+                    }
+                    result += c;
+                }
+                return result;
+            }
+    };
+
+    // Records its own lifetime as an event named 'name', which must outlive
+    // the recording (a string literal)
+    class Scope {
+        public:
+            explicit Scope(const char* n) : name {n}, start {Clock::now()} {}
+            ~Scope() {
+                Recorder::instance().record(name, start, Clock::now());
+            }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            const char* name;
+            Clock::time_point start;
+    };
+
+}
+
+#ifdef E3D_TRACE
+#define E3D_TRACE_CONCAT_(a, b) a##b
+#define E3D_TRACE_CONCAT(a, b) E3D_TRACE_CONCAT_(a, b)
+#define E3D_TRACE_SCOPE(name) trace::Scope E3D_TRACE_CONCAT(e3dTraceScope, __LINE__)(name)
+#define E3D_TRACE_THREAD_NAME(name) trace::Recorder::instance().setThreadName(name)
+#define E3D_TRACE_WRITE(filename) trace::Recorder::instance().write(filename)
+#else
+#define E3D_TRACE_SCOPE(name) ((void)0)
+#define E3D_TRACE_THREAD_NAME(name) ((void)0)
+#define E3D_TRACE_WRITE(filename) ((void)0)
+#endif
+
+#endif // TRACE_H_
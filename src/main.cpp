@@ -2,92 +2,150 @@
 #include "imgui.h"
 #include "imgui-SFML.h"
 #include "engine3d.hpp"
+#include "recorder.hpp"
+#include "pipeline.hpp"
+#include "timestep.hpp"
+#include "scene.hpp"
+#include "replay.hpp"
+#include "profiler.hpp"
+#include "profiler_gui.hpp"
+#include "trace.hpp"
 
-int main() {
+// Usage: 3dengine [--pipelined] [--hz steps-per-second] [--record events.log]
+//
+// --pipelined simulates the next frame on its own thread while the current
+// one renders; --hz sets the fixed simulation rate (default 60); --record
+// saves the input events of the session for the replay tool
+int main(int argc, char* argv[]) {
+    bool pipelined = false;
+    double simulationHz = 60;
+    std::string recordFile;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--pipelined") {
+            pipelined = true;
+        }
+        else if (arg == "--hz" && i + 1 < argc) {
+            simulationHz = std::max(1.0, std::atof(argv[++i]));
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        }
+    }
 
     Window win{};
     ImGui::SFML::Init(win);
     win.resetGLStates();
     Clock deltaClock;
     Time elapsedTime;
-    double rotation = 0.0;
-
-    e3d::Poly cube;
-    cube.triangles.push_back({{-1, -1, 1}, {1, -1, -1}, {1, -1, 1}});
-    cube.triangles.push_back({{-1, -1, 1}, {-1, -1, -1}, {1, -1, -1}});
-    cube.triangles.push_back({{-1, 1, 1}, {1, 1, 1}, {1, 1, -1}});
-    cube.triangles.push_back({{-1, 1, 1}, {1, 1, -1}, {-1, 1, -1}});
-    cube.triangles.push_back({{-1, -1, 1}, {1, -1, 1}, {1, 1, 1}});
-    cube.triangles.push_back({{-1, -1, 1}, {1, 1, 1}, {-1, 1, 1}});
-    cube.triangles.push_back({{-1, -1, -1}, {1, 1, -1}, {1, -1, -1}});
-    cube.triangles.push_back({{-1, -1, -1}, {-1, 1, -1}, {1, 1, -1}});
-    cube.triangles.push_back({{-1, -1, -1}, {-1, 1, 1}, {-1, 1, -1}});
-    cube.triangles.push_back({{-1, -1, -1}, {-1, -1, 1}, {-1, 1, 1}});
-    cube.triangles.push_back({{1, -1, 1}, {1, -1, -1}, {1, 1, -1}});
-    cube.triangles.push_back({{1, -1, 1}, {1, 1, -1}, {1, 1, 1}});
 
-    cube.move(0, 0, 1);
-    cube.rotate(0, 0, 0);
+    e3d::DemoScene demo;
+    e3d::Poly& cube = demo.cube;
+    e3d::EventLog events;
 
     double x = 1, y = 1, z = 1;
     matrix::Matrix4x4 obj2world;
 
-    e3d::Device dev {win, e3d::Camera(1, 10, 0.01f, 100.0f, 89.0f)};
-    dev.camera.setPosition(0, 0, 0);
+    e3d::Device dev {win, e3d::DemoScene::makeCamera()};
+    e3d::CommandBuffer commands {dev.frameArena()};
+    e3d::ParallelRecorder recorder;
+    std::vector<const e3d::Poly*> scene {&cube};
     cout << dev.camera.projectionMatrix() << "\n";
 
+    // Advances the simulation by 'seconds' of real time in fixed steps and
+    // poses 'target' between the last two simulated states
+    e3d::FixedTimestep timestep {simulationHz};
+    auto simulate = [&](const double seconds, e3d::Poly& target) {
+        for (int i = timestep.advance(seconds); i > 0; --i) {
+            demo.step(timestep.step());
+        }
+        demo.pose(target, timestep.alpha());
+    };
+
+    // In pipelined mode the simulation thread owns its own copy of the scene
+    // and the simulation state; the render thread only sees the snapshots it
+    // publishes
+    e3d::Poly simulatedCube = cube;
+    std::vector<const e3d::Poly*> simulatedScene {&simulatedCube};
+    std::unique_ptr<e3d::PipelinedSimulation<e3d::SceneSnapshot>> simulation;
+    if (pipelined) {
+        simulation = std::make_unique<e3d::PipelinedSimulation<e3d::SceneSnapshot>>(
+            [&, clock = Clock()](e3d::SceneSnapshot& snapshot) mutable {
+                E3D_TRACE_SCOPE("simulate");
+                simulate(clock.restart().asSeconds(), simulatedCube);
+                e3d::capture(simulatedScene, snapshot);
+            });
+    }
+
+    E3D_TRACE_THREAD_NAME("main");
     while (win.isOpen()) {
-        Event event;
-        while (win.pollEvent(event)) {
-            ImGui::SFML::ProcessEvent(event);
-            if (event.type == Event::Closed) {
-                win.close();
+        E3D_TRACE_SCOPE("frame");
+        prof::profiler().beginFrame();
+        {
+            E3D_PROFILE(prof::Stage::Events);
+            Event event;
+            if (!recordFile.empty()) {
+                events.beginFrame();
             }
-            if (event.type == Event::KeyPressed) {
-                switch (event.key.code) {
-                    case Keyboard::Q:
-                        win.close();
-                        break;
-                    case Keyboard::Left:
-                        dev.camera.move(-0.1, 0, 0);
-                        break;
-                    case Keyboard::Right:
-                        dev.camera.move(0.1, 0, 0);
-                        break;
-                    case Keyboard::Up:
-                        dev.camera.move(0, 0, -0.1);
-                        break;
-                    case Keyboard::Down:
-                        dev.camera.move(0, 0, 0.1);
-                        break;
-                    case Keyboard::A:
-                        dev.camera.rotate(0, 0, -0.01);
-                        break;
-                    case Keyboard::D:
-                        dev.camera.rotate(0, 0, 0.01);
-                        break;
-                    case Keyboard::W:
-                        dev.camera.rotate(-0.01, 0, 0);
-                        break;
-                    case Keyboard::S:
-                        dev.camera.rotate(0.01, 0, 0);
-                        break;
+            while (win.pollEvent(event)) {
+                ImGui::SFML::ProcessEvent(event);
+                if (!recordFile.empty()) {
+                    events.add(event);
+                }
+                if (!demo.handleEvent(event, dev.camera)) {
+                    win.close();
+                }
+                if (event.type == Event::KeyPressed) {
+                    cout << dev.camera.rotation << "\n";
                 }
-                cout << dev.camera.rotation << "\n";
             }
         }
 
         elapsedTime = deltaClock.restart();
-        ImGui::SFML::Update(win, elapsedTime);
-
-        rotation += elapsedTime.asSeconds() * 0.2;
+        {
+            E3D_TRACE_SCOPE("update");
+            ImGui::SFML::Update(win, elapsedTime);
+            // Uploads what the loader threads have decoded since last frame
+            finish_loads();
 
-        cube.setRotation(0, rotation, 0);
+            if (simulation) {
+                const e3d::SceneSnapshot* snapshot = simulation->beginFrame();
+                e3d::apply(*snapshot, {&cube});
+                simulation->endFrame();
+            }
+            else {
+                simulate(elapsedTime.asSeconds(), cube);
+            }
+        }
 
-        win.clear(Color::Black);
-        ImGui::SFML::Render(win);
-        cube.draw(dev);
-        win.display();
+        {
+            E3D_TRACE_SCOPE("draw");
+            win.clear(Color::Black);
+            dev.beginFrame();
+            commands.clear();
+            recorder.record(scene, dev.camera, commands);
+            commands.sort();
+            commands.submit(dev);
+            prof::drawOverlay(prof::profiler());
+            prof::drawRenderStats(dev.stats());
+            {
+                E3D_PROFILE(prof::Stage::ImGui);
+                E3D_TRACE_SCOPE("ImGui::SFML::Render");
+                ImGui::SFML::Render(win);
+            }
+            win.display();
+        }
+        prof::profiler().endFrame();
     }
     ImGui::SFML::Shutdown();
+
+    if (!recordFile.empty() && !events.save(recordFile)) {
+        cerr << "Failed to write " << recordFile << "\n";
+    }
+
+#ifdef E3D_TRACE
+    // Chrome trace of the whole run
+    const char* traceFile = std::getenv("E3D_TRACE_FILE");
+    E3D_TRACE_WRITE(traceFile ? traceFile : "trace.json");
+#endif
 }
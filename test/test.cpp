@@ -1,6 +1,97 @@
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
 #include "matrix.hpp"
 #include "engine3d.hpp"
+#include "raytracer.hpp"
+#include "rasterizer.hpp"
+#include "recorder.hpp"
+#include "jobs.hpp"
+#include "pipeline.hpp"
+#include "timestep.hpp"
+#include "scene.hpp"
+#include "replay.hpp"
+#include "imagediff.hpp"
+#include "maze_grid.hpp"
+
+// Counts heap allocations so tests can check that code paths don't allocate
+static std::atomic<long> heapAllocations {0};
+
+void* operator new(std::size_t size) {
+    ++heapAllocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// Backend that only records what reaches it, so Device can run without a window
+class CountingBackend : public e3d::Backend {
+    public:
+        sf::Vector2u size() const override {
+            return sf::Vector2u(640, 480);
+        }
+        void setMaterial(const e3d::Material&) override {
+            ++materialChanges;
+        }
+        std::uint64_t drawPolygon(const e3d::ScreenVertex*, const int count, e3d::FrameArena& arena) override {
+            ++polygons;
+            arena.allocate<e3d::ScreenVertex>(count);
+            return count;
+        }
+        std::uint64_t drawLines(const e3d::ScreenVertex*, const int count, e3d::FrameArena&) override {
+            return count;
+        }
+        int polygons = 0;
+        int materialChanges = 0;
+};
+
+#ifndef E3D_GOLDEN_DIR
+#define E3D_GOLDEN_DIR "test/golden"
+#endif
+
+// Compares a render with E3D_GOLDEN_DIR/<name>.png. On a mismatch the render
+// and a diff image are written to <name>.actual.png and <name>.diff.png in
+// the working directory. With E3D_UPDATE_GOLDENS set, the golden image is
+// replaced by the render instead.
+static void checkGolden(const std::string& name, const e3d::Framebuffer& fb,
+                        const double threshold = 0.1, const size_t maxMismatched = 0) {
+    std::string golden = std::string(E3D_GOLDEN_DIR) + "/" + name + ".png";
+    if (std::getenv("E3D_UPDATE_GOLDENS")) {
+        REQUIRE(fb.saveToFile(golden));
+        return;
+    }
+    sf::Image expected;
+    REQUIRE(expected.loadFromFile(golden));
+    sf::Image actual = fb.toImage();
+    e3d::ImageDiff diff = e3d::compareImages(expected, actual, threshold);
+    if (diff.mismatched > maxMismatched) {
+        actual.saveToFile(name + ".actual.png");
+        if (diff.diff.getSize().x > 0) {
+            diff.diff.saveToFile(name + ".diff.png");
+        }
+    }
+    INFO(name << ": " << diff.mismatched << " pixels differ, max delta " << diff.maxDelta);
+    REQUIRE(diff.mismatched <= maxMismatched);
+}
 
 TEST_CASE("Rows can be checked for equality", "[columns]") {
     matrix::Row<3> c {1, 2, 3};
@@ -74,6 +165,17 @@ TEST_CASE("Identity matrix times any matrix or row is that matrix or row", "[mat
     REQUIRE(r * matrix::I<3>() == r);
 }
 
+TEST_CASE("A matrix times its inverse is the identity", "[matrix]") {
+    matrix::Matrix4x4 m = e3d::buildRotationMatrix(0.3, 0.2, 0.1) * e3d::buildTraslationMatrix(1, 2, 3);
+    matrix::Matrix4x4 p = m * inverse(m);
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            REQUIRE(std::abs(p[i][j] - matrix::I<4>()[i][j]) < 1e-9);
+        }
+    }
+    REQUIRE_THROWS(inverse(matrix::Matrix<2, 2>{{{1, 2}, {2, 4}}}));
+}
+
 TEST_CASE("Homegeneous vectors can be normalized", "[row]") {
     matrix::Vector4 v {2, 4, 6, 2};
     matrix::Vector4 w {2, 4, 6, 0};
@@ -100,3 +202,1310 @@ TEST_CASE("Object-to-World matrix is correctly computed", "[poly]") {
         REQUIRE(frontTri.objectToWorldMatrix - matrix::I<4>() == 2*matrix::I<4>());
     }
 }
+
+
+TEST_CASE("Ray tracer sees the cube in front of the camera", "[raytracer]") {
+    e3d::Poly cube = e3d::makeCube();
+    e3d::Camera camera(1, 10, 0.01f, 100.0f, 89.0f);
+    camera.setPosition(0, 0, -5);
+    e3d::rt::Tracer tracer({&cube}, camera);
+    REQUIRE(tracer.triangleCount() == 12);
+
+    SECTION("The central ray hits the front face at the expected distance") {
+        e3d::rt::RayPacket packet;
+        for (auto& ray : packet.rays) {
+            ray = tracer.primaryRay(16, 16, 32, 32);
+        }
+        tracer.trace(packet);
+        REQUIRE(packet.rays[0].tri >= 0);
+        REQUIRE(std::abs(packet.rays[0].t - 4) < 1e-4);
+    }
+
+    SECTION("Rendering in parallel covers every pixel") {
+        e3d::rt::RenderResult result = tracer.render(64, 48, 4);
+        REQUIRE(result.rays == 64 * 48);
+        REQUIRE(result.pixels.size() == 64 * 48 * 4);
+        REQUIRE(result.pixels[(24 * 64 + 32) * 4] > 0);
+        REQUIRE(result.pixels[0] == 0);
+    }
+}
+
+TEST_CASE("BVH depth stays bounded for lopsided scenes", "[raytracer]") {
+    // Triangles spaced geometrically along each axis in turn: every SAH split
+    // peels off only the farthest one, which would nest about 70 levels
+    std::vector<e3d::rt::Tri> tris;
+    for (int a = 0; a < 3; ++a) {
+        for (float x = 1e-7f; x < 1e18f; x *= 12.5f) {
+            e3d::rt::Vec c {a == 0 ? x : 0, a == 1 ? x : 0, a == 2 ? x : 0};
+            e3d::rt::Vec v0 = c - e3d::rt::Vec{1 / 3.0f, 1 / 3.0f, 0}, e1 {1, 0, 0}, e2 {0, 1, 0};
+            tris.push_back({v0, e1, e2, {0, 0, 1}, v0 + (e1 + e2) * (1 / 3.0f)});
+        }
+    }
+    e3d::rt::BVH bvh;
+    bvh.build(tris);
+    REQUIRE(bvh.depth() == e3d::rt::BVH::maxDepth + 1);
+
+    // A ray near the origin walks down the whole chain
+    e3d::rt::RayPacket packet;
+    for (auto& ray : packet.rays) {
+        ray = {{0.1f, 0.1f, -1}, {0, 0, 1}, {10, 10, 1}, std::numeric_limits<float>::max(), -1};
+    }
+    bvh.intersect(packet);
+    REQUIRE(packet.rays[0].tri >= 0);
+    REQUIRE(std::abs(packet.rays[0].t - 1) < 1e-4);
+}
+
+TEST_CASE("Near plane clipping keeps the part of a triangle in front of the camera", "[clip]") {
+    matrix::Vector3 out[4];
+    matrix::Vector3 inFront[3] {{-1, -1, -5}, {1, -1, -5}, {0, 1, -5}};
+    matrix::Vector3 behind[3] {{-1, -1, 5}, {1, -1, 5}, {0, 1, 5}};
+    matrix::Vector3 straddling[3] {{-1, 0, -2}, {1, 0, -2}, {0, 0, 2}};
+    REQUIRE(e3d::clipNear(inFront, 3, out, 0.1) == 3);
+    REQUIRE(e3d::clipNear(behind, 3, out, 0.1) == 0);
+    REQUIRE(e3d::clipNear(straddling, 3, out, 1) == 4);
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(out[i][2] <= -1 + 1e-12);
+    }
+}
+
+TEST_CASE("Frame profiler aggregates stage times over recorded frames", "[profiler]") {
+    prof::FrameProfiler p;
+    for (int frame = 1; frame <= 100; ++frame) {
+        p.beginFrame();
+        p.add(prof::Stage::Raster, std::chrono::milliseconds(frame));
+        p.add(prof::Stage::Raster, std::chrono::milliseconds(frame));
+        p.endFrame();
+    }
+    REQUIRE(p.size() == 100);
+    REQUIRE(p.sample(0).stages[size_t(prof::Stage::Raster)] == 200);
+    prof::Stats stats = p.stats(prof::Stage::Raster);
+    REQUIRE(stats.min == 2);
+    REQUIRE(stats.avg == 101);
+    REQUIRE(stats.p99 == 200);
+    REQUIRE(p.stats(prof::Stage::Clip).avg == 0);
+
+    for (size_t frame = 0; frame < 2 * prof::FrameProfiler::history; ++frame) {
+        p.beginFrame();
+        p.endFrame();
+    }
+    REQUIRE(p.size() == prof::FrameProfiler::history);
+    REQUIRE(p.stats(prof::Stage::Raster).avg == 0);
+}
+
+TEST_CASE("Trace recorder writes Chrome trace events per thread", "[trace]") {
+    trace::Recorder& recorder = trace::Recorder::instance();
+    recorder.clear();
+    recorder.setThreadName("test \"main\"");
+    {
+        trace::Scope scope("outer");
+        trace::Scope inner("inner");
+    }
+    std::thread worker([] {
+        trace::Recorder::instance().setThreadName("worker");
+        trace::Scope scope("work");
+    });
+    worker.join();
+    REQUIRE(recorder.size() == 3);
+
+    std::ostringstream out;
+    recorder.write(out);
+    std::string json = out.str();
+    REQUIRE(json.find("\"traceEvents\":[") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"outer\"") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"work\"") != std::string::npos);
+    REQUIRE(json.find("test \\\"main\\\"") != std::string::npos);
+    REQUIRE(json.find("\"args\":{\"name\":\"worker\"}") != std::string::npos);
+    recorder.clear();
+    REQUIRE(recorder.size() == 0);
+}
+
+TEST_CASE("Trace recorder reads buffers while threads keep recording", "[trace]") {
+    trace::Recorder& recorder = trace::Recorder::instance();
+    recorder.clear();
+    const size_t events = 10000;
+    std::atomic<bool> done {false};
+    std::thread worker([&] {
+        for (size_t i = 0; i < events; ++i) {
+            trace::Scope scope("tick");
+        }
+        done = true;
+    });
+    size_t seen = 0;
+    while (!done) {
+        size_t n = recorder.size();
+        REQUIRE(n >= seen);
+        seen = n;
+        std::ostringstream out;
+        recorder.write(out);
+    }
+    worker.join();
+    REQUIRE(recorder.size() == events);
+
+    recorder.clear();
+    REQUIRE(recorder.size() == 0);
+    {
+        trace::Scope scope("after");
+    }
+    std::ostringstream out;
+    recorder.write(out);
+    REQUIRE(recorder.size() == 1);
+    REQUIRE(out.str().find("\"name\":\"tick\"") == std::string::npos);
+    REQUIRE(out.str().find("\"name\":\"after\"") != std::string::npos);
+    recorder.clear();
+}
+
+TEST_CASE("Triangles outside the view frustum are detected", "[clip]") {
+    e3d::Camera camera(1, 10, 0.01f, 100.0f, 90.0f);
+    matrix::Matrix4x4 p = camera.projectionMatrix();
+    matrix::Vector3 visible[3] {{-1, -1, -5}, {1, -1, -5}, {0, 1, -5}};
+    matrix::Vector3 partlyVisible[3] {{-1, 0, -5}, {20, 0, -5}, {20, 1, -5}};
+    matrix::Vector3 right[3] {{6, -1, -5}, {20, -1, -5}, {7, 1, -5}};
+    matrix::Vector3 tooFar[3] {{-1, -1, -500}, {1, -1, -500}, {0, 1, -500}};
+    REQUIRE_FALSE(e3d::outsideFrustum(visible, 3, p, camera.far));
+    REQUIRE_FALSE(e3d::outsideFrustum(partlyVisible, 3, p, camera.far));
+    REQUIRE(e3d::outsideFrustum(right, 3, p, camera.far));
+    REQUIRE(e3d::outsideFrustum(tooFar, 3, p, camera.far));
+}
+
+TEST_CASE("Frame arena hands out aligned memory and recycles it on reset", "[arena]") {
+    e3d::FrameArena arena(64);
+    char* c = arena.allocate<char>(3);
+    double* d = arena.allocate<double>(2);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0);
+    REQUIRE(reinterpret_cast<char*>(d) > c);
+    REQUIRE(arena.used() == 3 + 2 * sizeof(double));
+
+    SECTION("Allocations past the block come from overflow, and reset grows the block") {
+        double* big = arena.allocate<double>(100);
+        big[99] = 1;
+        REQUIRE(arena.capacity() == 64);
+        arena.reset();
+        REQUIRE(arena.used() == 0);
+        REQUIRE(arena.capacity() > 64 + 100 * sizeof(double));
+        long before = heapAllocations;
+        arena.allocate<double>(102);
+        arena.reset();
+        REQUIRE(heapAllocations == before);
+    }
+}
+
+TEST_CASE("Steady-state frames do not allocate from the heap", "[arena]") {
+    CountingBackend backend;
+    e3d::Device dev {backend, e3d::Camera(1, 10, 0.01f, 100.0f, 89.0f)};
+    dev.camera.setPosition(0, 0, -5);
+    e3d::Poly cube = e3d::makeCube();
+    e3d::Mesh axes {{0, 0, 0}, {1, 0, 0}, {0, 0, 0}, {0, 1, 0}};
+
+    auto frame = [&](const int i) {
+        dev.beginFrame();
+        cube.setRotation(0, 0.01 * i, 0);
+        cube.draw(dev);
+        dev.draw(axes, cube.objectToWorldMatrix);
+    };
+    for (int i = 0; i < 3; ++i) {
+        frame(i);
+    }
+    long before = heapAllocations;
+    for (int i = 3; i < 100; ++i) {
+        frame(i);
+    }
+    REQUIRE(heapAllocations == before);
+    REQUIRE(dev.stats().trianglesSubmitted == 12);
+    REQUIRE(dev.stats().trianglesCulled == 0);
+    REQUIRE(dev.stats().drawCalls == 12 + 1);
+    REQUIRE(backend.polygons == 12 * 100);
+    REQUIRE(dev.stats().bytesAllocated == dev.frameArena().used());
+
+    // A whole frame: recording on the job system, sorting and submitting
+    jobs::JobSystem system {3};
+    e3d::ParallelRecorder recorder {4, system};
+    std::vector<e3d::Poly> polys(40, e3d::makeCube());
+    std::vector<const e3d::Poly*> scene;
+    for (size_t i = 0; i < polys.size(); ++i) {
+        polys[i].move(int(i % 8) - 4.0, int(i / 8) - 2.0, -double(i % 5));
+        scene.push_back(&polys[i]);
+    }
+    auto recordedFrame = [&] {
+        dev.beginFrame();
+        e3d::CommandBuffer commands {dev.frameArena()};
+        recorder.record(scene, dev.camera, commands);
+        commands.sort();
+        commands.submit(dev);
+        return commands.size();
+    };
+    for (int i = 0; i < 10; ++i) {
+        recordedFrame();
+    }
+    before = heapAllocations;
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(recordedFrame() == polys.size());
+    }
+    REQUIRE(heapAllocations == before);
+    REQUIRE(dev.stats().trianglesSubmitted == 12 * polys.size());
+}
+
+TEST_CASE("Sort keys order by layer, then material, then depth front to back", "[commands]") {
+    REQUIRE(e3d::makeSortKey(0, 0, 1.0f) < e3d::makeSortKey(0, 0, 2.0f));
+    REQUIRE(e3d::makeSortKey(0, 0, 1000.0f) < e3d::makeSortKey(0, 1, 0.5f));
+    REQUIRE(e3d::makeSortKey(0, 9, 1000.0f) < e3d::makeSortKey(1, 0, 0.5f));
+    REQUIRE(e3d::makeSortKey(0, 0, -3.0f) == e3d::makeSortKey(0, 0, 0.0f));
+}
+
+TEST_CASE("Command buffer radix sorts packets by key and submits them in batches", "[commands]") {
+    CountingBackend backend;
+    e3d::Device dev {backend, e3d::Camera(1, 10, 0.01f, 100.0f, 89.0f)};
+    dev.camera.setPosition(0, 0, -5);
+    e3d::Material red {255, 0, 0};
+    dev.addMaterial(red);
+    dev.addMaterial(red);
+    dev.beginFrame();
+    e3d::CommandBuffer commands {dev.frameArena()};
+
+    std::vector<e3d::Poly> polys(300, e3d::makeCube());
+    for (size_t i = 0; i < polys.size(); ++i) {
+        polys[i].material = std::uint32_t(i % 3);
+        polys[i].move(0, 0, -double(i * 7919 % 300) * 0.1);
+        polys[i].record(commands, dev.camera);
+    }
+    REQUIRE(commands.size() == 300);
+    commands.sort();
+    for (size_t i = 1; i < commands.size(); ++i) {
+        REQUIRE(commands.key(i - 1) <= commands.key(i));
+        if (commands[i - 1].material == commands[i].material) {
+            REQUIRE(commands[i - 1].depth <= commands[i].depth);
+        }
+    }
+    commands.submit(dev);
+    REQUIRE(backend.materialChanges == 3);
+    REQUIRE(dev.stats().stateChanges == 3);
+    REQUIRE(dev.stats().trianglesSubmitted == 300 * 12);
+}
+
+TEST_CASE("Command buffers keep recording after a sort", "[commands]") {
+    e3d::FrameArena arena;
+    e3d::CommandBuffer commands {arena};
+    e3d::Poly cube = e3d::makeCube();
+    auto packet = [&](const std::uint32_t material) {
+        return e3d::DrawPacket{cube.triangles.data(), cube.triangles.size(), cube.objectToWorldMatrix, material, 0.0f};
+    };
+    // Keys differing in one byte take a single pass, leaving the entries
+    // in the sort's scratch array
+    for (std::uint32_t i = 0; i < 100; ++i) {
+        commands.record(packet(i), 99 - i);
+    }
+    commands.sort();
+    REQUIRE(commands[0].material == 99);
+    // Fills the rest of the current capacity, then grows past it
+    for (std::uint32_t i = 100; i < 300; ++i) {
+        commands.record(packet(i), 1000 + i);
+    }
+    commands.sort();
+    REQUIRE(commands.size() == 300);
+    for (std::uint32_t i = 0; i < 300; ++i) {
+        REQUIRE(commands[i].material == (i < 100 ? 99 - i : i));
+    }
+}
+
+TEST_CASE("Software backend fills depth-tested polygons", "[rasterizer]") {
+    e3d::Framebuffer fb(64, 64);
+    e3d::SoftwareBackend backend(fb);
+    e3d::FrameArena arena;
+    e3d::ScreenVertex far[4] {{0, 0, 0.5f, 1, {}}, {64, 0, 0.5f, 1, {}}, {64, 64, 0.5f, 1, {}}, {0, 64, 0.5f, 1, {}}};
+    e3d::ScreenVertex near[3] {{0, 0, 0.1f, 1, {}}, {32, 0, 0.1f, 1, {}}, {0, 32, 0.1f, 1, {}}};
+
+    backend.setMaterial(e3d::Material{255, 0, 0});
+    REQUIRE(backend.drawPolygon(far, 4, arena) == 64 * 64);
+    backend.setMaterial(e3d::Material{0, 255, 0});
+    std::uint64_t nearPixels = backend.drawPolygon(near, 3, arena);
+    REQUIRE(nearPixels > 0);
+    REQUIRE(nearPixels < 32 * 32);
+    REQUIRE(fb.color[0] == e3d::packColor(0, 255, 0));
+    REQUIRE(fb.color[63 * 64 + 63] == e3d::packColor(255, 0, 0));
+
+    e3d::ScreenVertex middle[4] {{0, 0, 0.3f, 1, {}}, {64, 0, 0.3f, 1, {}}, {64, 64, 0.3f, 1, {}}, {0, 64, 0.3f, 1, {}}};
+    backend.setMaterial(e3d::Material{0, 0, 255});
+    REQUIRE(backend.drawPolygon(middle, 4, arena) == 64 * 64 - nearPixels);
+    REQUIRE(backend.drawPolygon(far, 4, arena) == 0);
+    REQUIRE(fb.color[0] == e3d::packColor(0, 255, 0));
+    REQUIRE(fb.pixels()[0] == 0);
+    REQUIRE(fb.pixels()[1] == 255);
+}
+
+TEST_CASE("Parallel recording matches serial recording", "[commands]") {
+    e3d::Camera camera(1, 10, 0.01f, 100.0f, 89.0f);
+    std::vector<e3d::Poly> polys;
+    for (int i = 0; i < 1000; ++i) {
+        polys.push_back(e3d::makeCube());
+        polys.back().material = i % 5;
+        polys.back().move((i % 10 - 5) * 3, (i / 10 % 10 - 5) * 3, -(i / 100) * 3 - 4);
+    }
+    polys[0].move(0, 0, 200);  // behind the camera
+    polys[1].move(500, 0, 0);  // far off to the side
+    std::vector<const e3d::Poly*> scene;
+    for (const auto& p : polys) {
+        scene.push_back(&p);
+    }
+
+    e3d::FrameArena serialArena, parallelArena;
+    e3d::CommandBuffer serial {serialArena}, parallel {parallelArena};
+    e3d::ParallelRecorder one {1}, four {4};
+    one.record(scene, camera, serial);
+    four.record(scene, camera, parallel);
+    serial.sort();
+    parallel.sort();
+
+    REQUIRE(four.threadCount() == 4);
+    REQUIRE(one.culledObjects >= 2);
+    REQUIRE(four.culledObjects == one.culledObjects);
+    REQUIRE(parallel.size() == serial.size());
+    REQUIRE(parallel.size() + four.culledObjects == 1000);
+    for (size_t i = 0; i < serial.size(); ++i) {
+        REQUIRE(parallel.key(i) == serial.key(i));
+        REQUIRE(parallel[i].triangles == serial[i].triangles);
+    }
+}
+
+TEST_CASE("Work-stealing deque pops LIFO for its owner and steals FIFO", "[jobs]") {
+    jobs::WorkStealingDeque<int> deque {4};
+    int items[5] = {0, 1, 2, 3, 4};
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(deque.push(&items[i]));
+    }
+    REQUIRE_FALSE(deque.push(&items[4]));
+    REQUIRE(deque.steal() == &items[0]);
+    REQUIRE(deque.pop() == &items[3]);
+    REQUIRE(deque.pop() == &items[2]);
+    REQUIRE(deque.steal() == &items[1]);
+    REQUIRE(deque.pop() == nullptr);
+    REQUIRE(deque.steal() == nullptr);
+    REQUIRE(deque.empty());
+}
+
+TEST_CASE("Job system runs every job, nested jobs and dependent jobs", "[jobs]") {
+    jobs::JobSystem system {4};
+    REQUIRE(system.threadCount() == 4);
+
+    std::vector<int> hits(100000);
+    system.parallelFor(0, hits.size(), 64, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            ++hits[i];
+        }
+    });
+    REQUIRE(std::count(hits.begin(), hits.end(), 1) == int(hits.size()));
+
+    // Jobs spawning jobs onto their own worker's deque
+    std::atomic<int> leaves {0};
+    jobs::Counter nested;
+    for (int i = 0; i < 16; ++i) {
+        system.run([&] {
+            for (int j = 0; j < 16; ++j) {
+                system.run([&] { ++leaves; }, nested);
+            }
+        }, nested);
+    }
+    system.wait(nested);
+    REQUIRE(leaves == 256);
+
+    // Second stage only starts once the whole first stage is done
+    std::atomic<int> first {0};
+    std::atomic<int> seenBySecond {-1};
+    jobs::Counter stage1, stage2;
+    for (int i = 0; i < 64; ++i) {
+        system.run([&] { ++first; }, stage1);
+    }
+    system.runAfter(stage1, [&] { seenBySecond = first.load(); }, stage2);
+    system.wait(stage2);
+    REQUIRE(stage1.done());
+    REQUIRE(seenBySecond == 64);
+}
+
+TEST_CASE("Counters can be destroyed as soon as wait returns", "[jobs]") {
+    // parallelFor's counter lives on its stack; the last job must be done
+    // with it before wait() returns. Run under -fsanitize=address or thread
+    // to catch a late access.
+    jobs::JobSystem system {4};
+    std::atomic<int> items {0};
+    for (int i = 0; i < 2000; ++i) {
+        system.parallelFor(0, 8, 1, [&](const size_t begin, const size_t end) {
+            items += int(end - begin);
+        });
+    }
+    REQUIRE(items == 16000);
+
+    for (int i = 0; i < 500; ++i) {
+        auto counter = std::make_unique<jobs::Counter>();
+        jobs::Counter after;
+        for (int j = 0; j < 4; ++j) {
+            system.run([] {}, *counter);
+        }
+        system.runAfter(*counter, [] {}, after);
+        system.wait(after);
+        system.wait(*counter);
+        counter.reset();
+    }
+}
+
+TEST_CASE("Frame pipeline hands every simulated frame to the renderer in order", "[pipeline]") {
+    std::atomic<int> simulated {0};
+    {
+        e3d::PipelinedSimulation<std::vector<int>> simulation {[&](std::vector<int>& state) {
+            state.assign(16, ++simulated);
+        }};
+        for (int frame = 1; frame <= 1000; ++frame) {
+            const std::vector<int>* state = simulation.beginFrame();
+            REQUIRE(state != nullptr);
+            REQUIRE(state->size() == 16);
+            REQUIRE(std::count(state->begin(), state->end(), frame) == 16);
+            simulation.endFrame();
+        }
+        // At most the two slots are ever ahead of the renderer
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(simulated <= 1002);
+    }
+
+    // stop() releases a consumer waiting for a frame that never comes
+    e3d::FramePipeline<int> pipeline;
+    int sentinel = 0;
+    const int* unblocked = &sentinel;
+    std::thread consumer([&] {
+        unblocked = pipeline.beginRead();
+    });
+    pipeline.stop();
+    consumer.join();
+    REQUIRE(unblocked == nullptr);
+}
+
+TEST_CASE("Fixed timestep runs the same steps at any frame rate", "[timestep]") {
+    e3d::FixedTimestep fast {60}, slow {60};
+    int fastSteps = 0, slowSteps = 0;
+    for (int frame = 0; frame < 240; ++frame) {
+        fastSteps += fast.advance(1.0 / 240);
+    }
+    for (int frame = 0; frame < 30; ++frame) {
+        slowSteps += slow.advance(1.0 / 30);
+    }
+    REQUIRE(std::abs(fastSteps - 60) <= 1);
+    REQUIRE(std::abs(slowSteps - 60) <= 1);
+    REQUIRE(fast.totalSteps() == std::uint64_t(fastSteps));
+
+    e3d::FixedTimestep timestep {10, 4};
+    REQUIRE(timestep.advance(0.05) == 0);
+    REQUIRE(timestep.alpha() == Catch::Approx(0.5));
+    REQUIRE(timestep.advance(0.1) == 1);
+    REQUIRE(timestep.alpha() == Catch::Approx(0.5));
+    // A long stall is capped and the excess time dropped
+    REQUIRE(timestep.advance(10) == 4);
+    REQUIRE(timestep.droppedSteps() == 96);
+    REQUIRE(timestep.alpha() == Catch::Approx(0.5));
+    REQUIRE(timestep.advance(0) == 0);
+
+    REQUIRE(e3d::interpolate(2.0, 4.0, 0.25) == Catch::Approx(2.5));
+    matrix::Vector3 mid = e3d::interpolate(matrix::Vector3{0, 0, 0}, matrix::Vector3{2, 4, 6}, 0.5);
+    REQUIRE(mid == matrix::Vector3{1, 2, 3});
+}
+
+TEST_CASE("Event logs round-trip and replay to the same frames", "[replay]") {
+    e3d::EventLog log;
+    sf::Event left {}, close {};
+    left.type = sf::Event::KeyPressed;
+    left.key.code = sf::Keyboard::Left;
+    left.key.shift = true;
+    close.type = sf::Event::Closed;
+    sf::Event moved {};
+    moved.type = sf::Event::MouseMoved;
+    log.beginFrame();
+    log.add(left);
+    log.add(moved);
+    log.beginFrame();
+    log.beginFrame();
+    log.add(close);
+
+    std::stringstream text;
+    log.write(text);
+    e3d::EventLog loaded;
+    REQUIRE(loaded.read(text));
+    REQUIRE(loaded.frameCount() == 3);
+    REQUIRE(loaded.frame(0).size() == 1);
+    REQUIRE(loaded.frame(0)[0].key.code == sf::Keyboard::Left);
+    REQUIRE(loaded.frame(0)[0].key.shift);
+    REQUIRE(loaded.frame(1).empty());
+    REQUIRE(loaded.frame(2)[0].type == sf::Event::Closed);
+    e3d::EventLog malformed;
+    std::stringstream bad("frame\nkey-pressed x\n");
+    REQUIRE_FALSE(malformed.read(bad));
+
+    REQUIRE(e3d::hashBytes("a", 1) == 0xaf63dc4c8601ec8cull);
+
+    auto replay = [&](const e3d::EventLog& events) {
+        e3d::Framebuffer fb {64, 48};
+        e3d::SoftwareBackend backend {fb};
+        e3d::Device dev {backend, e3d::DemoScene::makeCamera()};
+        e3d::DemoScene demo;
+        std::uint64_t hash = e3d::hashBytes(nullptr, 0);
+        for (size_t f = 0; f < events.frameCount(); ++f) {
+            for (const sf::Event& e : events.frame(f)) {
+                demo.handleEvent(e, dev.camera);
+            }
+            demo.step(1.0 / 60);
+            demo.pose(demo.cube, 1);
+            fb.clear();
+            dev.beginFrame();
+            demo.cube.draw(dev);
+            hash = e3d::hashBytes(fb.pixels(), fb.color.size() * 4, hash);
+        }
+        return hash;
+    };
+    REQUIRE(replay(loaded) == replay(log));
+    REQUIRE(replay(loaded) != replay(e3d::EventLog {}));
+}
+
+TEST_CASE("Image diff tolerates small color shifts and flags real changes", "[golden]") {
+    sf::Image a, b;
+    a.create(8, 8, sf::Color(100, 100, 100));
+    b.create(8, 8, sf::Color(102, 100, 99));
+    REQUIRE(e3d::compareImages(a, b).mismatched == 0);
+    REQUIRE(e3d::compareImages(a, a).maxDelta == 0);
+
+    b.setPixel(3, 4, sf::Color(255, 0, 0));
+    e3d::ImageDiff diff = e3d::compareImages(a, b);
+    REQUIRE(diff.mismatched == 1);
+    REQUIRE(diff.diff.getPixel(3, 4) == sf::Color::Red);
+    REQUIRE(diff.diff.getPixel(0, 0) != sf::Color::Red);
+
+    sf::Image black, white, small;
+    black.create(2, 2, sf::Color::Black);
+    white.create(2, 2, sf::Color::White);
+    small.create(1, 1, sf::Color::Black);
+    REQUIRE(e3d::compareImages(black, white).maxDelta > 0.95);
+    REQUIRE(e3d::compareImages(black, small).mismatched == 4);
+}
+
+TEST_CASE("Rendered scenes match their golden images", "[golden]") {
+    e3d::Framebuffer fb {160, 120};
+    e3d::SoftwareBackend backend {fb};
+    e3d::Device dev {backend, e3d::DemoScene::makeCamera()};
+    std::uint32_t red = dev.addMaterial(e3d::Material{220, 40, 40});
+    std::uint32_t green = dev.addMaterial(e3d::Material{40, 200, 60});
+    std::uint32_t blue = dev.addMaterial(e3d::Material{50, 80, 230});
+    dev.beginFrame();
+
+    SECTION("Rotated cube") {
+        e3d::DemoScene demo;
+        demo.cube.setRotation(0.5, 0.6, 0);
+        demo.cube.draw(dev);
+        checkGolden("cube", fb);
+    }
+
+    SECTION("Overlapping cubes sorted by material and depth") {
+        std::vector<e3d::Poly> cubes(3, e3d::makeCube());
+        cubes[0].material = red;
+        cubes[1].material = green;
+        cubes[2].material = blue;
+        cubes[0].move(-1.2, 0.4, 1);
+        cubes[1].move(0, 0, 2);
+        cubes[2].move(1.0, -0.4, 0);
+        e3d::CommandBuffer commands {dev.frameArena()};
+        for (e3d::Poly& cube : cubes) {
+            cube.setRotation(0.3, 0.4, 0.1);
+            cube.record(commands, dev.camera);
+        }
+        commands.sort();
+        commands.submit(dev);
+        checkGolden("cubes", fb);
+    }
+
+    SECTION("Cube cut by the near plane") {
+        e3d::Poly cube = e3d::makeCube();
+        cube.material = green;
+        cube.setRotation(0, 0.7, 0);
+        dev.camera.setPosition(1.1, 0, -1.3);
+        cube.draw(dev);
+        REQUIRE(dev.stats().trianglesClipped > 0);
+        checkGolden("near_clip", fb);
+    }
+
+    SECTION("Textured cube, bilinear and mipmapped") {
+        std::vector<std::uint32_t> checker(64 * 64);
+        for (int y = 0; y < 64; ++y) {
+            for (int x = 0; x < 64; ++x) {
+                checker[y * 64 + x] = (x / 8 + y / 8) % 2 ? e3d::packColor(250, 200, 60) : e3d::packColor(40, 60, 160);
+            }
+        }
+        e3d::Texture texture;
+        texture.create(64, 64, reinterpret_cast<const std::uint8_t*>(checker.data()));
+        e3d::Material textured;
+        textured.texture = &texture;
+        e3d::Poly cube = e3d::makeCube();
+        cube.material = dev.addMaterial(textured);
+        cube.setRotation(0.5, 0.6, 0);
+        cube.draw(dev);
+        checkGolden("textured_cube", fb);
+    }
+}
+
+TEST_CASE("Textures keep a mip chain and sample nearest or bilinear", "[texture]") {
+    // 8x4 texture: left half black, right half white
+    std::vector<std::uint32_t> texels(8 * 4);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            texels[y * 8 + x] = x < 4 ? e3d::packColor(0, 0, 0) : e3d::packColor(255, 255, 255);
+        }
+    }
+    e3d::Texture texture;
+    texture.create(8, 4, reinterpret_cast<const std::uint8_t*>(texels.data()));
+    REQUIRE(texture.levelCount() == 4);
+    REQUIRE(texture.width(1) == 4);
+    REQUIRE(texture.height(2) == 1);
+    REQUIRE(texture.width(3) == 1);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            REQUIRE(texture.texel(0, x, y) == texels[y * 8 + x]);
+        }
+    }
+    REQUIRE(texture.texel(0, -1, 0) == texels[7]);
+    REQUIRE(texture.texel(1, 1, 0) == e3d::packColor(0, 0, 0));
+    REQUIRE(texture.texel(3, 0, 0) == e3d::packColor(128, 128, 128));
+
+    REQUIRE(texture.sample(0.1f, 0.5f, 0, e3d::Filter::Nearest) == e3d::packColor(0, 0, 0));
+    REQUIRE(texture.sample(0.9f, 0.5f, 0, e3d::Filter::Nearest) == e3d::packColor(255, 255, 255));
+    // Halfway across the black/white edge
+    REQUIRE(texture.sample(0.5f, 0.5f, 0, e3d::Filter::Bilinear) == e3d::packColor(127, 127, 127));
+    REQUIRE(texture.sample(0.1f, 0.5f, 10, e3d::Filter::Nearest) == e3d::packColor(128, 128, 128));
+
+    // One texel per pixel is level 0, four texels per pixel level 2
+    REQUIRE(texture.lod(1.0f / 8, 0, 0, 1.0f / 4) == Catch::Approx(0).margin(1e-5));
+    REQUIRE(texture.lod(4.0f / 8, 0, 0, 4.0f / 4) == Catch::Approx(2).margin(1e-5));
+}
+
+TEST_CASE("Mip chains match a scalar box filter at any size", "[texture]") {
+    for (unsigned int w : {1u, 2u, 7u, 9u, 16u, 33u}) {
+        for (unsigned int h : {1u, 3u, 8u}) {
+            sf::Image image;
+            image.create(w, h);
+            for (unsigned int y = 0; y < h; ++y) {
+                for (unsigned int x = 0; x < w; ++x) {
+                    image.setPixel(x, y, sf::Color(sf::Uint8(x * 37 + y * 11), sf::Uint8(x * y * 5 + 3),
+                                                   sf::Uint8(255 - x * 13), sf::Uint8(y * 71 + x)));
+                }
+            }
+            std::vector<sf::Image> chain = basix::build_mip_chain(image);
+            REQUIRE(chain.size() == size_t(std::log2(std::max(w, h))) + 1);
+            REQUIRE(chain.back().getSize() == sf::Vector2u(1, 1));
+            for (size_t level = 1; level < chain.size(); ++level) {
+                const sf::Image& src = chain[level - 1];
+                const sf::Image& dst = chain[level];
+                unsigned int sw = src.getSize().x, sh = src.getSize().y;
+                REQUIRE(dst.getSize() == sf::Vector2u(std::max(sw / 2, 1u), std::max(sh / 2, 1u)));
+                for (unsigned int y = 0; y < dst.getSize().y; ++y) {
+                    for (unsigned int x = 0; x < dst.getSize().x; ++x) {
+                        sf::Color p[4] = {src.getPixel(std::min(2 * x, sw - 1), std::min(2 * y, sh - 1)),
+                                          src.getPixel(std::min(2 * x + 1, sw - 1), std::min(2 * y, sh - 1)),
+                                          src.getPixel(std::min(2 * x, sw - 1), std::min(2 * y + 1, sh - 1)),
+                                          src.getPixel(std::min(2 * x + 1, sw - 1), std::min(2 * y + 1, sh - 1))};
+                        sf::Color expected((p[0].r + p[1].r + p[2].r + p[3].r + 2) / 4,
+                                           (p[0].g + p[1].g + p[2].g + p[3].g + 2) / 4,
+                                           (p[0].b + p[1].b + p[2].b + p[3].b + 2) / 4,
+                                           (p[0].a + p[1].a + p[2].a + p[3].a + 2) / 4);
+                        REQUIRE(dst.getPixel(x, y) == expected);
+                    }
+                }
+            }
+
+            // The software rasterizer's texture takes the same levels
+            e3d::Texture texture;
+            REQUIRE(texture.loadFromMipmaps(chain));
+            REQUIRE(texture.levelCount() == int(chain.size()));
+            sf::Color last = chain.back().getPixel(0, 0);
+            REQUIRE(texture.texel(texture.levelCount() - 1, 0, 0) == e3d::packColor(last.r, last.g, last.b, last.a));
+        }
+    }
+}
+
+TEST_CASE("Textured triangles are interpolated perspective-correctly", "[texture][rasterizer]") {
+    // Texture whose texel color encodes its column
+    std::vector<std::uint32_t> texels(256);
+    for (int x = 0; x < 256; ++x) {
+        texels[x] = e3d::packColor(x, 0, 0);
+    }
+    e3d::Texture ramp;
+    ramp.create(256, 1, reinterpret_cast<const std::uint8_t*>(texels.data()));
+
+    e3d::Framebuffer fb {64, 64};
+    e3d::SoftwareBackend backend {fb};
+    e3d::Material material;
+    material.texture = &ramp;
+    material.filter = e3d::Filter::Nearest;
+    backend.setMaterial(material);
+    e3d::FrameArena arena;
+    // Quad whose right edge is four times as far away as its left edge
+    e3d::ScreenVertex quad[4] = {{0, 0, 0, 1, {0, 0}}, {64, 0, 0, 0.25f, {1, 0}},
+                                 {64, 64, 0, 0.25f, {1, 1}}, {0, 64, 0, 1, {0, 1}}};
+    REQUIRE(backend.drawPolygon(quad, 4, arena) == 64 * 64);
+    // Halfway across the screen u = (0.5 * 0.25) / (0.5 * 1 + 0.5 * 0.25) = 0.2, not 0.5
+    std::uint8_t middle[4];
+    std::memcpy(middle, &fb.color[32 * 64 + 32], 4);
+    REQUIRE(std::abs(middle[0] - int(0.2 * 256)) <= 3);
+    // Vertex colors modulate the texel and alpha below one half is discarded
+    fb.clear();
+    for (auto& v : quad) {
+        v.attributes.g = 0.5f;
+        v.attributes.a = 0.25f;
+    }
+    quad[0].attributes.a = quad[3].attributes.a = 1;
+    material.texture = nullptr;
+    backend.setMaterial(material);
+    std::uint64_t written = backend.drawPolygon(quad, 4, arena);
+    REQUIRE(written > 0);
+    REQUIRE(written < 64 * 64);
+    REQUIRE(fb.color[32 * 64 + 1] == e3d::packColor(255, 128, 255));
+    REQUIRE(fb.color[32 * 64 + 62] == e3d::packColor(0, 0, 0));
+}
+
+// Resource for Resource_holder tests: the contents of a text file
+struct TextFile {
+    std::string contents;
+
+    bool loadFromFile(const std::string& filename) {
+        std::ifstream in(filename);
+        std::stringstream text;
+        text << in.rdbuf();
+        contents = text.str();
+        return bool(in);
+    }
+
+    bool loadFromMemory(const void* data, std::size_t size) {
+        contents.assign(static_cast<const char*>(data), size);
+        return true;
+    }
+};
+
+TEST_CASE("Resource holders load asynchronously and finish on the main thread", "[resources]") {
+    std::vector<std::string> files;
+    for (int i = 0; i < 4; ++i) {
+        files.push_back("resource_holder_test_" + std::to_string(i) + ".txt");
+        std::ofstream(files.back()) << "file " << i;
+    }
+    basix::Resource_holder<TextFile, std::string> holder;
+    std::vector<std::shared_future<TextFile*>> loads;
+    for (const std::string& f : files) {
+        loads.push_back(holder.load_async(f, f));
+    }
+    // Loading an id twice shares the pending load
+    REQUIRE(holder.load_async(files[0], files[0]).valid());
+    REQUIRE(holder.pending_loads() == files.size());
+    auto missing = holder.load_async("missing", "resource_holder_test_missing.txt");
+
+    // The first load is finished on demand, the rest within the frame budget
+    REQUIRE(holder.get(files[0]).contents == "file 0");
+    REQUIRE(loads[0].wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    while (holder.finish_loads(sf::milliseconds(1)) > 0) {
+        std::this_thread::yield();
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+        REQUIRE(holder.is_loaded(files[i]));
+        REQUIRE(loads[i].get() == &holder.get(files[i]));
+        REQUIRE(loads[i].get()->contents == "file " + std::to_string(i));
+    }
+    REQUIRE_FALSE(holder.is_loaded("missing"));
+    REQUIRE_THROWS_AS(missing.get(), std::runtime_error);
+    REQUIRE_THROWS_AS(holder.load("missing", "resource_holder_test_missing.txt"), std::runtime_error);
+
+    // Already loaded ids come back ready
+    REQUIRE(holder.load_async(files[1], files[1]).get() == &holder.get(files[1]));
+    for (const std::string& f : files) {
+        std::remove(f.c_str());
+    }
+}
+
+TEST_CASE("Resource holders cache, share and evict resources", "[resources]") {
+    std::vector<std::string> files;
+    for (int i = 0; i < 3; ++i) {
+        files.push_back("resource_cache_test_" + std::to_string(i) + ".txt");
+    }
+    std::ofstream(files[0]) << "same";
+    std::ofstream(files[1]) << "same";
+    std::ofstream(files[2]) << "other";
+    basix::Resource_holder<TextFile, std::string> holder;
+    holder.set_deduplication(true);
+
+    // A second load of an id reuses it, even once the file is gone
+    auto a = holder.load("a", files[0]);
+    std::remove(files[0].c_str());
+    REQUIRE(holder.load("a", files[0]) == a);
+    REQUIRE(holder.references("a") == 2);
+    REQUIRE(&holder.get(a) == &holder.get("a"));
+
+    // Identical files under different ids share one resource
+    holder.load("b", files[1]);
+    REQUIRE(&holder.get("a") == &holder.get("b"));
+    REQUIRE(holder.handle("b") == a);
+    REQUIRE(holder.references("b") == 3);
+    REQUIRE(holder.load_async("c", files[2]).valid());
+    while (holder.pending_loads() > 0) {
+        holder.finish_loads(sf::milliseconds(1));
+    }
+    REQUIRE(holder.get("c").contents == "other");
+    REQUIRE(&holder.get("c") != &holder.get("a"));
+    // Deduplicated resources also keep their file's bytes
+    REQUIRE(holder.memory_used() == 2 * sizeof(TextFile) + 4 + 5);
+
+    // Only unreferenced resources are evicted, least recently used first
+    holder.set_memory_budget(sizeof(TextFile));
+    REQUIRE(holder.is_loaded("a"));
+    REQUIRE(holder.is_loaded("c"));
+    holder.release("a");
+    holder.release("b");
+    holder.release("a");
+    REQUIRE(holder.references("a") == 0);
+    REQUIRE(holder.is_loaded("c"));
+    REQUIRE_FALSE(holder.is_loaded("a"));
+    REQUIRE_FALSE(holder.is_loaded("b"));
+    REQUIRE(holder.memory_used() == sizeof(TextFile) + 5);
+
+    // A handle to an evicted resource stays invalid when its slot is reused
+    REQUIRE_FALSE(holder.is_loaded(a));
+    REQUIRE_FALSE(holder.handle("a").valid());
+    REQUIRE_THROWS_AS(holder.get(a), std::runtime_error);
+    REQUIRE_THROWS_AS(holder.get("a"), std::runtime_error);
+    holder.set_memory_budget(0);
+    std::ofstream(files[0]) << "again";
+    auto again = holder.load("a", files[0]);
+    REQUIRE(again.index == a.index);
+    REQUIRE(again != a);
+    REQUIRE_FALSE(holder.is_loaded(a));
+    REQUIRE(holder.get(again).contents == "again");
+
+    for (const std::string& f : files) {
+        std::remove(f.c_str());
+    }
+}
+
+TEST_CASE("Texture atlases pack images into pages and round-trip", "[atlas]") {
+    basix::Texture_atlas atlas {"test_atlas", 32, 1};
+    const sf::Vector2u sizes[] = {{20, 20}, {16, 8}, {10, 10}, {30, 30}, {1, 5}};
+    for (int i = 0; i < 5; ++i) {
+        sf::Image image;
+        image.create(sizes[i].x, sizes[i].y, sf::Color(sf::Uint8(40 * i), 255, sf::Uint8(200 - 40 * i)));
+        image.setPixel(0, 0, sf::Color::Red);
+        atlas.add("image" + std::to_string(i), image);
+    }
+    REQUIRE(atlas.pack());
+    REQUIRE(atlas.page_count() >= 2);
+
+    auto check = [&](const basix::Texture_atlas& a) {
+        for (int i = 0; i < 5; ++i) {
+            std::string id = "image" + std::to_string(i);
+            REQUIRE(a.contains(id));
+            const basix::Atlas_region& r = a.region(id);
+            REQUIRE(r.rect.width == int(sizes[i].x));
+            REQUIRE(r.rect.height == int(sizes[i].y));
+            REQUIRE(basix::texture_holder.is_loaded(r.page));
+            // The page holds the image where the region says
+            const sf::Image* page = nullptr;
+            for (size_t p = 0; p < a.page_count(); ++p) {
+                if (basix::texture_holder.handle("test_atlas#1/" + std::to_string(p)) == r.page ||
+                    basix::texture_holder.handle("atlas_test_" + std::to_string(p) + ".png") == r.page) {
+                    page = &a.page_image(p);
+                }
+            }
+            REQUIRE(page != nullptr);
+            REQUIRE(page->getPixel(r.rect.left, r.rect.top) == sf::Color::Red);
+            REQUIRE(page->getPixel(r.rect.left + r.rect.width - 1, r.rect.top + r.rect.height - 1) ==
+                    sf::Color(sf::Uint8(40 * i), 255, sf::Uint8(200 - 40 * i)));
+            // Regions on the same page keep their padding apart
+            for (int j = 0; j < i; ++j) {
+                const basix::Atlas_region& other = a.region("image" + std::to_string(j));
+                if (other.page == r.page) {
+                    sf::IntRect padded {r.rect.left, r.rect.top, r.rect.width + 1, r.rect.height + 1};
+                    REQUIRE_FALSE(padded.intersects(other.rect));
+                }
+            }
+        }
+    };
+    check(atlas);
+
+    // Repacking gives back the previous pages
+    REQUIRE(basix::texture_holder.references("test_atlas#1/0") == 1);
+    {
+        basix::Texture_atlas repacked {"test_atlas_repack", 32, 1};
+        sf::Image image;
+        image.create(8, 8);
+        repacked.add("image", image);
+        REQUIRE(repacked.pack());
+        REQUIRE(repacked.pack());
+        REQUIRE(basix::texture_holder.references("test_atlas_repack#1/0") == 0);
+        REQUIRE(basix::texture_holder.references("test_atlas_repack#2/0") == 1);
+    }
+    REQUIRE(basix::texture_holder.references("test_atlas_repack#2/0") == 0);
+
+    REQUIRE(atlas.save("atlas_test"));
+    basix::Texture_atlas loaded;
+    REQUIRE(loaded.load("atlas_test"));
+    REQUIRE(loaded.page_count() == atlas.page_count());
+    check(loaded);
+    for (size_t p = 0; p < atlas.page_count(); ++p) {
+        std::remove(("atlas_test_" + std::to_string(p) + ".png").c_str());
+    }
+    std::remove("atlas_test.atlas");
+
+    sf::Image large;
+    large.create(40, 8);
+    atlas.add("large", large);
+    REQUIRE_FALSE(atlas.pack());
+}
+
+TEST_CASE("Sprite batches draw once per texture and layer", "[batch]") {
+    sf::Texture cells, heroes;
+    basix::Sprite_batch batch;
+    REQUIRE(batch.draw_calls() == 0);
+    for (int i = 0; i < 100; ++i) {
+        sf::Transform transform;
+        transform.translate(float(i % 10) * 32, float(i / 10) * 32);
+        batch.add(i % 3 ? cells : heroes, sf::IntRect(0, 0, 32, 32), transform);
+    }
+    REQUIRE(batch.size() == 100);
+    REQUIRE(batch.draw_calls() == 2);
+    // Layers are drawn in order, each split by texture
+    sf::Texture items;
+    batch.add(items, sf::IntRect(0, 0, 8, 8), sf::Transform::Identity, sf::Color::White, 1);
+    REQUIRE(batch.draw_calls() == 3);
+    batch.add(cells, sf::IntRect(0, 0, 8, 8), sf::Transform::Identity, sf::Color::White, 2);
+    batch.add(heroes, sf::IntRect(0, 0, 8, 8), sf::Transform::Identity, sf::Color::White, 2);
+    REQUIRE(batch.draw_calls() == 5);
+    batch.clear();
+    REQUIRE(batch.size() == 0);
+    REQUIRE(batch.draw_calls() == 0);
+}
+
+TEST_CASE("Tile layers lay out a grid and track the tiles to upload", "[batch]") {
+    basix::Tile_layer layer {sf::Vector2i(3, 4), sf::Vector2f(10, 20), sf::Vector2f(5, 5)};
+    REQUIRE(layer.tile_count() == 12);
+    REQUIRE(layer.dirty_tiles() == 12);
+    // Tile 6 is row 1, column 2
+    const sf::Vertex* quad = layer.tile_vertices(6);
+    REQUIRE(quad[0].position == sf::Vector2f(25, 25));
+    REQUIRE(quad[2].position == sf::Vector2f(35, 45));
+
+    layer.set_tile(6, sf::IntRect(32, 0, 16, 16));
+    REQUIRE(quad[0].texCoords == sf::Vector2f(32, 0));
+    REQUIRE(quad[2].texCoords == sf::Vector2f(48, 16));
+    layer.set_color(9, sf::Color::Red);
+    REQUIRE(layer.tile_vertices(9)[3].color == sf::Color::Red);
+}
+
+TEST_CASE("Maze grids store one byte per cell", "[maze]") {
+    Maze_grid grid {sf::Vector2i(3, 5)};
+    REQUIRE(sizeof(CellType) == 1);
+    REQUIRE(grid.size() == 15);
+    REQUIRE(grid.type(7) == CellType::Wall);
+    REQUIRE_FALSE(grid.can_enter(7));
+    grid.set_type(7, CellType::Corridor);
+    grid.set_type(14, CellType::Exit);
+    REQUIRE(grid.can_enter(7));
+    REQUIRE(grid.can_enter(14));
+    REQUIRE_FALSE(grid.can_enter(-1));
+    REQUIRE_FALSE(grid.can_enter(15));
+    REQUIRE(grid.data()[7] == CellType::Corridor);
+
+    REQUIRE(grid.cell_num(sf::Vector2i(1, 2)) == 7);
+    REQUIRE(grid.cell_num(sf::Vector2i(3, 0)) == -1);
+    REQUIRE(grid.position(7) == sf::Vector2i(1, 2));
+    REQUIRE(grid.neighbours(7) == std::vector<int> {2, 12, 6, 8});
+    REQUIRE(grid.neighbours(0) == std::vector<int> {5, 1});
+    REQUIRE(grid.neighbours(14) == std::vector<int> {9, 13});
+}
+
+TEST_CASE("Bit-packed collision masks match a per-pixel test", "[collision]") {
+    // Ring-shaped sprites, wide enough to span several mask words
+    auto ring = [](unsigned int w, unsigned int h) {
+        sf::Image image;
+        image.create(w, h, sf::Color::Transparent);
+        for (unsigned int y = 0; y < h; ++y) {
+            for (unsigned int x = 0; x < w; ++x) {
+                float dx = (x + 0.5f) / w - 0.5f, dy = (y + 0.5f) / h - 0.5f;
+                float r = dx * dx + dy * dy;
+                image.setPixel(x, y, sf::Color(255, 255, 255, r < 0.25f && r > 0.1f ? 200 : 40));
+            }
+        }
+        return image;
+    };
+    sf::Image image1 = ring(150, 40), image2 = ring(70, 90);
+    Collision::Bitmask mask1 = Collision::MakeBitmask(image1, 100);
+    Collision::Bitmask mask2 = Collision::MakeBitmask(image2, 100);
+    REQUIRE(mask1.WordsPerRow == 4);
+    REQUIRE(mask1.Get(75, 2));
+    REQUIRE_FALSE(mask1.Get(75, 20));
+    REQUIRE_FALSE(Collision::MakeBitmask(image1, 200).Get(75, 2));
+
+    sf::IntRect rect1(0, 0, 150, 40), rect2(0, 0, 70, 90);
+    auto reference = [&](const sf::Transform& t1, const sf::Transform& t2) {
+        sf::Transform inverse1 = t1.getInverse(), inverse2 = t2.getInverse();
+        for (int y = -250; y < 250; ++y) {
+            for (int x = -250; x < 350; ++x) {
+                sf::Vector2f p1 = inverse1.transformPoint(float(x), float(y));
+                sf::Vector2f p2 = inverse2.transformPoint(float(x), float(y));
+                if (p1.x >= 0 && p1.x < 150 && p1.y >= 0 && p1.y < 40 && p2.x >= 0 && p2.x < 70 &&
+                    p2.y >= 0 && p2.y < 90 && mask1.Get(unsigned(p1.x), unsigned(p1.y)) &&
+                    mask2.Get(unsigned(p2.x), unsigned(p2.y))) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    auto placed = [](float x, float y, float degrees, float scale) {
+        float c = std::cos(degrees * 3.14159265f / 180) * scale, s = std::sin(degrees * 3.14159265f / 180) * scale;
+        return sf::Transform(c, -s, x, s, c, y, 0, 0, 1);
+    };
+    int hits = 0, turnedHits = 0;
+    for (int dy = -100; dy <= 60; dy += 13) {
+        for (int dx = -80; dx <= 160; dx += 17) {
+            // Whole-pixel offsets take the shift-AND path, the rest the transformed path
+            sf::Transform moved = placed(float(dx), float(dy), 0, 1);
+            bool expected = reference(sf::Transform::Identity, moved);
+            REQUIRE(Collision::MasksOverlap(mask1, rect1, sf::Transform::Identity, mask2, rect2, moved) == expected);
+            hits += expected;
+            sf::Transform turned = placed(dx + 0.3f, dy + 0.6f, float(dx + dy), 1.2f);
+            expected = reference(placed(0.5f, 0, 10, 1), turned);
+            REQUIRE(Collision::MasksOverlap(mask1, rect1, placed(0.5f, 0, 10, 1), mask2, rect2, turned) == expected);
+            turnedHits += expected;
+        }
+    }
+    REQUIRE(hits > 0);
+    REQUIRE(turnedHits > 0);
+
+    // Texture rects reaching past the texture, as for repeated textures: the
+    // pixels outside it are unset
+    sf::IntRect big1(-20, -10, 200, 70), big2(30, 40, 90, 80);
+    auto set = [](const Collision::Bitmask& mask, const sf::IntRect& rect, sf::Vector2f p) {
+        if (p.x < 0 || p.x >= rect.width || p.y < 0 || p.y >= rect.height) {
+            return false;
+        }
+        int x = int(p.x) + rect.left, y = int(p.y) + rect.top;
+        return x >= 0 && y >= 0 && x < int(mask.Width) && y < int(mask.Height) && mask.Get(unsigned(x), unsigned(y));
+    };
+    int bigHits = 0;
+    for (int step = 0; step < 12; ++step) {
+        for (float degrees : {0.f, 25.f}) {
+            sf::Transform t1 = placed(-5, 3, 0, 1), t2 = placed(step * 17.f - 60, step * 9.f - 40, degrees, 1);
+            sf::Transform inverse1 = t1.getInverse(), inverse2 = t2.getInverse();
+            bool expected = false;
+            for (int y = -150; y < 250 && !expected; ++y) {
+                for (int x = -150; x < 300 && !expected; ++x) {
+                    expected = set(mask1, big1, inverse1.transformPoint(float(x), float(y))) &&
+                               set(mask2, big2, inverse2.transformPoint(float(x), float(y)));
+                }
+            }
+            REQUIRE(Collision::MasksOverlap(mask1, big1, t1, mask2, big2, t2) == expected);
+            bigHits += expected;
+        }
+    }
+    REQUIRE(bigHits > 0);
+    REQUIRE_FALSE(Collision::MasksOverlap(mask1, sf::IntRect(150, 0, 50, 40), sf::Transform::Identity,
+                                          mask2, rect2, sf::Transform::Identity));
+}
+
+TEST_CASE("Oriented box sets agree with BoundingBoxTest", "[collision]") {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(-150, 150), angle(0, 360), scale(0.5f, 2);
+    std::uniform_int_distribution<int> size(5, 60);
+    // 23 sprites, so the SIMD loop also sees a partly filled last group
+    std::vector<sf::Sprite> sprites(23);
+    for (sf::Sprite& sprite : sprites) {
+        sprite.setTextureRect(sf::IntRect(0, 0, size(rng), size(rng)));
+        sprite.setOrigin(5, 5);
+        sprite.setPosition(position(rng), position(rng));
+        sprite.setRotation(angle(rng));
+        sprite.setScale(scale(rng), scale(rng));
+    }
+    Collision::OrientedBoxSet boxes;
+    std::vector<Collision::OrientedBoxSet::Box> ids;
+    for (const sf::Sprite& sprite : sprites) {
+        ids.push_back(boxes.Add(sprite));
+    }
+    auto check = [&] {
+        int hits = 0;
+        for (size_t i = 0; i < sprites.size(); ++i) {
+            if (!boxes.Sprite(ids[i])) {
+                continue;
+            }
+            std::vector<Collision::OrientedBoxSet::Box> found;
+            boxes.Query(ids[i], found);
+            std::vector<Collision::OrientedBoxSet::Box> expected;
+            for (size_t j = 0; j < sprites.size(); ++j) {
+                if (j != i && boxes.Sprite(ids[j]) && Collision::BoundingBoxTest(sprites[i], sprites[j])) {
+                    expected.push_back(ids[j]);
+                    REQUIRE(boxes.Test(ids[i], ids[j]));
+                }
+            }
+            std::sort(found.begin(), found.end());
+            std::sort(expected.begin(), expected.end());
+            REQUIRE(found == expected);
+            hits += int(found.size());
+        }
+        return hits;
+    };
+    REQUIRE(check() > 0);
+
+    // Boxes are only recomputed for sprites that changed
+    for (size_t i = 0; i < sprites.size(); i += 3) {
+        sprites[i].move(20, -10);
+        sprites[i].rotate(30);
+    }
+    sprites[1].setTextureRect(sf::IntRect(0, 0, 80, 8));
+    size_t refreshed = 0;
+    for (auto id : ids) {
+        refreshed += boxes.Refresh(id);
+    }
+    REQUIRE(refreshed == 9);
+    REQUIRE(check() > 0);
+
+    boxes.Remove(ids[4]);
+    boxes.Remove(ids[5]);
+    check();
+    std::vector<Collision::OrientedBoxSet::Box> found;
+    boxes.Query(sprites[4], found);
+    REQUIRE(std::find(found.begin(), found.end(), ids[4]) == found.end());
+}
+
+TEST_CASE("Spatial hashes report the same pairs as testing every pair", "[collision]") {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-300, 300), size(1, 90);
+    Collision::SpatialHash grid(48);
+    std::vector<Collision::SpatialHash::Proxy> proxies;
+    for (int i = 0; i < 200; ++i) {
+        proxies.push_back(grid.Add(sf::FloatRect(position(rng), position(rng), size(rng), size(rng))));
+    }
+    auto bruteForce = [&] {
+        std::set<std::pair<Collision::SpatialHash::Proxy, Collision::SpatialHash::Proxy>> pairs;
+        for (size_t i = 0; i < proxies.size(); ++i) {
+            for (size_t j = i + 1; j < proxies.size(); ++j) {
+                if (grid.Bounds(proxies[i]).intersects(grid.Bounds(proxies[j]))) {
+                    pairs.emplace(std::min(proxies[i], proxies[j]), std::max(proxies[i], proxies[j]));
+                }
+            }
+        }
+        return pairs;
+    };
+    auto hashed = [&] {
+        auto pairs = grid.Pairs();
+        std::set<std::pair<Collision::SpatialHash::Proxy, Collision::SpatialHash::Proxy>> unique(pairs.begin(), pairs.end());
+        REQUIRE(unique.size() == pairs.size());  // each pair reported once
+        return unique;
+    };
+    REQUIRE_FALSE(bruteForce().empty());
+    REQUIRE(hashed() == bruteForce());
+
+    // Small steps mostly stay in the same cells, large ones change them
+    for (size_t i = 0; i < proxies.size(); ++i) {
+        sf::FloatRect bounds = grid.Bounds(proxies[i]);
+        float step = i % 2 ? 3.f : 70.f;
+        grid.Move(proxies[i], sf::FloatRect(bounds.left + step, bounds.top - step, bounds.width, bounds.height));
+    }
+    REQUIRE(hashed() == bruteForce());
+
+    for (size_t i = 0; i < 50; ++i) {
+        grid.Remove(proxies.back());
+        proxies.pop_back();
+    }
+    REQUIRE(hashed() == bruteForce());
+
+    std::vector<Collision::SpatialHash::Proxy> found;
+    sf::FloatRect area(-100, -100, 150, 120);
+    grid.Query(area, found);
+    std::vector<Collision::SpatialHash::Proxy> expected;
+    for (auto proxy : proxies) {
+        if (grid.Bounds(proxy).intersects(area)) {
+            expected.push_back(proxy);
+        }
+    }
+    std::sort(found.begin(), found.end());
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(found == expected);
+}
+
+TEST_CASE("Random numbers are in range and repeatable from a seed", "[random]") {
+    basix::seed_random(42);
+    std::vector<int> first;
+    for (int i = 0; i < 100; ++i) {
+        first.push_back(basix::random_int(-3, 3));
+    }
+    basix::seed_random(42);
+    std::vector<int> counts(7);
+    for (int i = 0; i < 100; ++i) {
+        int value = basix::random_int(-3, 3);
+        REQUIRE(value == first[i]);
+        ++counts[value + 3];
+    }
+    for (int i = 0; i < 7000; ++i) {
+        ++counts[basix::random_int(-3, 3) + 3];
+    }
+    for (int count : counts) {
+        REQUIRE(count > 800);
+        REQUIRE(count < 1200);
+    }
+    REQUIRE(basix::random_int(5, 5) == 5);
+    REQUIRE_THROWS(basix::random_int(2, 1));
+    REQUIRE_THROWS(basix::random_double(2, 1));
+
+    std::vector<double> doubles(1000);
+    basix::random_fill(doubles, -1.0, 1.0);
+    double sum = 0;
+    for (double d : doubles) {
+        REQUIRE(d >= -1.0);
+        REQUIRE(d < 1.0);
+        sum += d;
+    }
+    REQUIRE(std::abs(sum / doubles.size()) < 0.1);
+    std::vector<float> floats(1000);
+    basix::random_fill(floats, 2.f, 4.f);
+    REQUIRE(*std::min_element(floats.begin(), floats.end()) >= 2.f);
+    REQUIRE(*std::max_element(floats.begin(), floats.end()) <= 4.f);
+    std::vector<int> ints(1000);
+    basix::random_fill(ints, 0, 1);
+    REQUIRE(std::count(ints.begin(), ints.end(), 1) > 400);
+
+    // Bulk fills draw the same numbers as single calls
+    basix::seed_random(7);
+    basix::random_fill(ints, -1000, 1000);
+    basix::seed_random(7);
+    for (int value : ints) {
+        REQUIRE(basix::random_int(-1000, 1000) == value);
+    }
+
+    // Every thread has its own engine
+    std::vector<double> other(100);
+    std::thread([&] { basix::random_fill(other, 0.0, 1.0); }).join();
+    std::vector<double> mine(100);
+    basix::random_fill(mine, 0.0, 1.0);
+    REQUIRE(other != mine);
+}
+
+TEST_CASE("Job system benchmarks", "[!benchmark]") {
+    BENCHMARK_ADVANCED("spawn and wait for 1000 empty jobs")(Catch::Benchmark::Chronometer meter) {
+        jobs::JobSystem& system = jobs::scheduler();
+        meter.measure([&] {
+            jobs::Counter counter;
+            for (int i = 0; i < 1000; ++i) {
+                system.run([] {}, counter);
+            }
+            system.wait(counter);
+        });
+    };
+
+    std::vector<double> data(1 << 20);
+    auto kernel = [&](jobs::JobSystem& system) {
+        system.parallelFor(0, data.size(), 4096, [&](const size_t begin, const size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                data[i] = std::sqrt(double(i)) * std::sin(double(i));
+            }
+        });
+        return data[data.size() / 2];
+    };
+    for (int threads : {1, 2, 4, 8}) {
+        jobs::JobSystem system {threads};
+        BENCHMARK("parallelFor over 1M items, " + std::to_string(threads) + " workers") {
+            return kernel(system);
+        };
+    }
+}
@@ -0,0 +1,57 @@
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "basix.hpp"
+
+// Packs sprite images into texture atlas pages ahead of time, for
+// Texture_atlas::load(). Images keep the path they are given on the command
+// line as their id, so Sprite("images/hero.png") finds its region when the
+// game runs from the same directory.
+// Usage: atlas output-prefix [--page-size 2048] [--padding 2] image...
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: atlas output-prefix [--page-size 2048] [--padding 2] image...\n";
+        return 2;
+    }
+    std::string prefix = argv[1];
+    unsigned int pageSize = 2048;
+    unsigned int padding = 2;
+    std::vector<std::string> images;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--page-size" && i + 1 < argc) {
+            pageSize = std::atoi(argv[++i]);
+        }
+        else if (arg == "--padding" && i + 1 < argc) {
+            padding = std::atoi(argv[++i]);
+        }
+        else {
+            images.push_back(arg);
+        }
+    }
+
+    Texture_atlas atlas {"atlas", pageSize, padding};
+    try {
+        for (const std::string& image : images) {
+            atlas.add_file(image, image);
+        }
+    }
+    catch (const std::exception& e) {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    if (!atlas.pack(false)) {
+        cerr << "An image is larger than a " << pageSize << "x" << pageSize << " page\n";
+        return 1;
+    }
+    if (!atlas.save(prefix)) {
+        cerr << "Failed to write " << prefix << ".atlas\n";
+        return 1;
+    }
+    cerr << images.size() << " images packed into " << atlas.page_count() << " pages:\n";
+    for (size_t page = 0; page < atlas.page_count(); ++page) {
+        sf::Vector2u size = atlas.page_image(page).getSize();
+        cerr << "  " << prefix << "_" << page << ".png " << size.x << "x" << size.y << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include <cstdlib>
+#include "basix.hpp"
+#include "engine3d.hpp"
+#include "raytracer.hpp"
+
+// Headless offline render of the demo scene.
+// Usage: raytrace [width] [height] [output.png] [threads]
+int main(int argc, char *argv[]) {
+    unsigned int width = argc > 1 ? std::atoi(argv[1]) : 1024;
+    unsigned int height = argc > 2 ? std::atoi(argv[2]) : 1024;
+    std::string output = argc > 3 ? argv[3] : "raytrace.png";
+    int threads = argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+
+    e3d::Poly cube = e3d::makeCube();
+    cube.move(0, 0, 1);
+    cube.setRotation(0.5, 0.6, 0);
+
+    e3d::Camera camera(1, 10, 0.01f, 100.0f, 89.0f);
+    camera.setPosition(0, 0, -5);
+
+    e3d::rt::Tracer tracer({&cube}, camera);
+    e3d::rt::RenderResult result = tracer.render(width, height, threads);
+
+    cout << width << "x" << height << " px, " << tracer.triangleCount() << " triangles, "
+         << threads << " threads, " << result.tilesStolen << " tiles stolen\n";
+    cout << result.rays << " rays in " << result.seconds << " s: "
+         << result.raysPerSecond() / 1e6 << " Mrays/s\n";
+
+    if (!result.saveToFile(output)) {
+        cerr << "Failed to write " << output << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include "basix.hpp"
+#include "engine3d.hpp"
+#include "rasterizer.hpp"
+#include "recorder.hpp"
+#include "replay.hpp"
+#include "scene.hpp"
+#include "timestep.hpp"
+
+// Headless, deterministic replay of a recorded session (3dengine --record).
+// Every logged frame feeds its events to the demo scene, advances the
+// simulation by exactly one fixed step and renders into a software
+// framebuffer, so the same log always produces the same images.
+// Prints the time and image hash of every frame, then a summary.
+// Usage: replay events.log [width] [height] [hz] [last-frame.png]
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: replay events.log [width] [height] [hz] [last-frame.png]\n";
+        return 2;
+    }
+    e3d::EventLog log;
+    if (!log.load(argv[1])) {
+        cerr << "Failed to read " << argv[1] << "\n";
+        return 1;
+    }
+    unsigned int width = argc > 2 ? std::atoi(argv[2]) : 640;
+    unsigned int height = argc > 3 ? std::atoi(argv[3]) : 480;
+    double hz = argc > 4 ? std::max(1.0, std::atof(argv[4])) : 60;
+
+    e3d::Framebuffer framebuffer {width, height};
+    e3d::SoftwareBackend backend {framebuffer};
+    e3d::Device dev {backend, e3d::DemoScene::makeCamera()};
+    e3d::DemoScene demo;
+    e3d::FixedTimestep timestep {hz};
+    e3d::CommandBuffer commands {dev.frameArena()};
+    e3d::ParallelRecorder recorder;
+    std::vector<const e3d::Poly*> scene {&demo.cube};
+
+    std::vector<double> times;
+    std::uint64_t runHash = e3d::hashBytes(nullptr, 0);
+    std::uint64_t frameHash = runHash;
+    cout << "frame,ms,hash\n" << std::hex;
+    for (size_t f = 0; f < log.frameCount(); ++f) {
+        auto start = std::chrono::steady_clock::now();
+        bool quit = false;
+        for (const sf::Event& event : log.frame(f)) {
+            quit = !demo.handleEvent(event, dev.camera) || quit;
+        }
+        if (quit) {
+            break;
+        }
+        for (int i = timestep.advance(timestep.step()); i > 0; --i) {
+            demo.step(timestep.step());
+        }
+        demo.pose(demo.cube, timestep.alpha());
+
+        framebuffer.clear();
+        dev.beginFrame();
+        commands.clear();
+        recorder.record(scene, dev.camera, commands);
+        commands.sort();
+        commands.submit(dev);
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        frameHash = e3d::hashBytes(framebuffer.pixels(), framebuffer.color.size() * 4);
+        runHash = e3d::hashBytes(&frameHash, sizeof(frameHash), runHash);
+        cout << std::dec << f << "," << times.back() << "," << std::hex << std::setw(16)
+             << std::setfill('0') << frameHash << "\n";
+    }
+    cout << std::dec;
+
+    if (times.empty()) {
+        cerr << "No frames replayed\n";
+        return 1;
+    }
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0;
+    for (double t : times) {
+        total += t;
+    }
+    cerr << times.size() << " frames at " << width << "x" << height << ": avg "
+         << total / times.size() << " ms, min " << sorted.front() << " ms, p99 "
+         << sorted[std::min(sorted.size() - 1, size_t(sorted.size() * 0.99))] << " ms, max "
+         << sorted.back() << " ms\n";
+    cerr << "run hash " << std::hex << std::setw(16) << std::setfill('0') << runHash << std::dec << "\n";
+
+    if (argc > 5 && !framebuffer.saveToFile(argv[5])) {
+        cerr << "Failed to write " << argv[5] << "\n";
+        return 1;
+    }
+    return 0;
+}